@@ -0,0 +1,179 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "statsc.h"
+
+// An arena hands out memory by bumping a pointer through large chunks, and
+// gives all of it back at once when it is released. Everything the
+// interpreter builds while reading a program (map nodes, syntax trees,
+// functions) lives in one, so tearing the interpreter down is a single
+// freeArena instead of a walk over every structure.
+//
+// Small blocks that are given back early (map nodes, arrays that grew) go on
+// a free list for their size class and are handed out again before the bump
+// pointer moves, so maps that are created and freed over and over (one per
+// function the resolver sees) keep reusing the same memory. What only lives
+// as long as one top-level statement goes in an arena of its own, which is
+// reset once the statement has run.
+//
+//      chunks -> | header | used ......... | free          |
+//                                          ^ next          ^ end
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 16
+// blocks up to this size are recycled through free lists when given back
+#define ARENA_MAX_POOLED 512
+#define ARENA_CLASSES (ARENA_MAX_POOLED / ARENA_ALIGNMENT)
+
+typedef struct ArenaChunk {
+    struct ArenaChunk* next;
+    uint64_t size;
+} ArenaChunk;
+
+// a block sitting on a free list
+typedef struct ArenaFreeBlock {
+    struct ArenaFreeBlock* next;
+} ArenaFreeBlock;
+
+typedef struct Arena {
+    ArenaChunk* chunks;
+    char* next;                         // first free byte of the newest chunk
+    char* end;
+    ArenaFreeBlock* freeLists[ARENA_CLASSES];   // freeLists[i] holds blocks of (i + 1) * ARENA_ALIGNMENT bytes
+} Arena;
+
+// the size a request is rounded up to
+uint64_t arenaRound(uint64_t size) {
+    if (size == 0) {
+        size = 1;
+    }
+    return (size + ARENA_ALIGNMENT - 1) & ~((uint64_t) ARENA_ALIGNMENT - 1);
+}
+
+// a fresh chunk with room for at least size bytes after its header
+char* arenaNewChunk(Arena* arena, uint64_t size) {
+    uint64_t header = arenaRound(sizeof(ArenaChunk));
+    STAT_ADD(arenaChunks, 1);
+    ArenaChunk* chunk = (ArenaChunk*) (malloc(header + size));
+    if (chunk == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    chunk -> next = arena -> chunks;
+    chunk -> size = size;
+    arena -> chunks = chunk;
+    return (char*) chunk + header;
+}
+
+// returns size bytes of uninitialized memory that stays valid until the arena is released
+void* arenaAlloc(Arena* arena, uint64_t size) {
+    size = arenaRound(size);
+
+    // reuse a block of the same size class if one was given back
+    if (size <= ARENA_MAX_POOLED) {
+        ArenaFreeBlock** list = &(arena -> freeLists[size / ARENA_ALIGNMENT - 1]);
+        if (*list != NULL) {
+            ArenaFreeBlock* block = *list;
+            *list = block -> next;
+            return block;
+        }
+    }
+
+    if (size > (uint64_t) (arena -> end - arena -> next)) {
+        // large blocks get a chunk of their own, so the current chunk keeps its free space
+        if (size > ARENA_CHUNK_SIZE / 4) {
+            return arenaNewChunk(arena, size);
+        }
+        arena -> next = arenaNewChunk(arena, ARENA_CHUNK_SIZE);
+        arena -> end = arena -> next + ARENA_CHUNK_SIZE;
+    }
+    void* block = arena -> next;
+    arena -> next += size;
+    return block;
+}
+
+// same as arenaAlloc, but the memory is zeroed
+void* arenaCalloc(Arena* arena, uint64_t size) {
+    void* block = arenaAlloc(arena, size);
+    memset(block, 0, size);
+    return block;
+}
+
+// gives a block back before the arena is released, size must be the size it was allocated with
+void arenaFree(Arena* arena, void* block, uint64_t size) {
+    if (block == NULL) {
+        return;
+    }
+    size = arenaRound(size);
+    // larger blocks stay where they are until the whole arena goes
+    if (size <= ARENA_MAX_POOLED) {
+        ArenaFreeBlock* freed = (ArenaFreeBlock*) block;
+        ArenaFreeBlock** list = &(arena -> freeLists[size / ARENA_ALIGNMENT - 1]);
+        freed -> next = *list;
+        *list = freed;
+    }
+}
+
+// grows (or shrinks) a block, keeping its contents
+void* arenaRealloc(Arena* arena, void* block, uint64_t oldSize, uint64_t newSize) {
+    if (block != NULL && arenaRound(oldSize) == arenaRound(newSize)) {
+        return block;
+    }
+    void* grown = arenaAlloc(arena, newSize);
+    if (block != NULL) {
+        memcpy(grown, block, (oldSize < newSize) ? oldSize : newSize);
+        arenaFree(arena, block, oldSize);
+    }
+    return grown;
+}
+
+void arenaConstructor(Arena* arena) {
+    memset(arena, 0, sizeof(Arena));
+}
+
+// gives back everything allocated from the arena at once, but keeps the chunk it is bumping
+// through, so an arena that is filled and emptied over and over does not go back to malloc
+void arenaReset(Arena* arena) {
+    uint64_t header = arenaRound(sizeof(ArenaChunk));
+    ArenaChunk* kept = NULL;
+    ArenaChunk* chunk = arena -> chunks;
+    while (chunk != NULL) {
+        ArenaChunk* next = chunk -> next;
+        if ((char*) chunk + header + chunk -> size == arena -> end) {
+            kept = chunk;
+        }
+        else {
+            free(chunk);
+        }
+        chunk = next;
+    }
+    arenaConstructor(arena);
+    if (kept != NULL) {
+        kept -> next = NULL;
+        arena -> chunks = kept;
+        arena -> next = (char*) kept + header;
+        arena -> end = arena -> next + kept -> size;
+    }
+}
+
+// releases everything ever allocated from the arena
+void freeArena(Arena* arena) {
+    ArenaChunk* chunk = arena -> chunks;
+    while (chunk != NULL) {
+        ArenaChunk* next = chunk -> next;
+        free(chunk);
+        chunk = next;
+    }
+    arenaConstructor(arena);
+}
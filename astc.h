@@ -0,0 +1,184 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "slicec.h"
+#include "arenac.h"
+#include "lexerc.h"
+
+typedef enum ExpressionKind {
+    EXPRESSION_LITERAL,
+    EXPRESSION_VARIABLE,
+    EXPRESSION_CALL,
+    // written by the optimizer: evaluates left and also stores the value in frame slot slot
+    EXPRESSION_SHARE,
+
+    // unary: a run of !'s either negates its operand (odd count) or turns it into 0 / 1 (even count)
+    EXPRESSION_NOT,
+    EXPRESSION_TRUTH,
+
+    // binary, in the same precedence order as e3 .. e12
+    EXPRESSION_MULTIPLY,
+    EXPRESSION_DIVIDE,
+    EXPRESSION_MODULO,
+    EXPRESSION_ADD,
+    EXPRESSION_SUBTRACT,
+    EXPRESSION_LESS,
+    EXPRESSION_LESS_EQUAL,
+    EXPRESSION_GREATER,
+    EXPRESSION_GREATER_EQUAL,
+    EXPRESSION_EQUAL,
+    EXPRESSION_NOT_EQUAL,
+    EXPRESSION_AND,
+    EXPRESSION_OR
+} ExpressionKind;
+
+// where a variable lives, filled in by the resolver
+typedef enum Scope {
+    SCOPE_GLOBAL,                       // global[symbol]
+    SCOPE_PARAMETER,                    // slot of the running function's frame
+    SCOPE_LOCAL                         // slot of the running function's frame once assigned, global[symbol] until then
+} Scope;
+
+// where a call is made, which decides how it runs and where it fails
+typedef enum CallPosition {
+    CALL_NESTED,                        // inside an expression
+    CALL_STATEMENT,                     // a statement of its own
+    CALL_TAIL                           // its value is returned right away (return f(...)), it takes over the caller's frame
+} CallPosition;
+
+typedef struct Expression {
+    uint8_t kind;
+    uint8_t scope;                      // where the variable read lives
+    uint8_t position;                   // where a call is made
+    bool pure;                          // no call anywhere in the expression (filled in by the optimizer)
+    uint32_t offset;                    // where the expression starts in the program
+    union {
+        uint64_t value;                 // literal value
+        uint64_t symbol;                // interned id of the name read or called, also its index into the globals and functions
+    };
+    uint32_t slot;
+    uint32_t hash;                      // equal for expressions with the same structure (filled in by the optimizer)
+    struct Expression* left;            // operand of unary and binary expressions
+    struct Expression* right;
+    struct Expression** arguments;      // arguments of a call
+    uint32_t numArguments;
+    uint32_t end;                       // a call: just after its )
+    union {
+        struct Function* target;        // a call: the function it reached last time, parsed and taking numArguments
+        // && and ||: filled in by the optimizer when the right operand can be skipped once the left one
+        // decides, unless one of these calls has effects. NULL terminated
+        struct Expression** calls;
+    };
+} Expression;
+
+typedef enum StatementKind {
+    STATEMENT_ASSIGN,
+    STATEMENT_CALL,
+    STATEMENT_IF,
+    STATEMENT_WHILE,
+    STATEMENT_RETURN,
+    STATEMENT_FUN
+} StatementKind;
+
+// filled in by the optimizer: common statements the tree walker runs in one step
+typedef enum StatementShape {
+    SHAPE_GENERIC,
+    SHAPE_INCREMENT,                    // x = x + literal, or x - literal
+    SHAPE_ACCUMULATE,                   // x = x + an expression without calls
+    SHAPE_COMPARE,                      // if / while on a comparison of two variables or literals
+    SHAPE_COUNTED                       // while (i < n) { ...; i = i + k }, nothing else assigns i or n
+} StatementShape;
+
+// a list of statements between { and }
+typedef struct Block {
+    struct Statement** statements;
+    uint64_t length;
+    uint64_t capacity;
+} Block;
+
+struct Interpreter;
+struct Purity;
+
+typedef struct Function {
+    Slice name;
+    uint64_t symbol;                    // interned id of the name
+    uint32_t offset;                    // where the declaration starts in the program
+    uint64_t numParams;
+    uint64_t* parameters;               // interned ids of the parameter names
+
+    // the body is parsed and resolved the first time the function is called
+    Token* tokens;                      // the body's tokens after its {, up to a TOKEN_END after its }
+    bool parsed;
+    Block body;
+    uint64_t frameSize;                 // parameters and locals, filled in by the resolver
+
+    // filled in by the bytecode compiler, also on the first call
+    bool compiled;
+    uint64_t entry;                     // index of the first instruction of the body
+    uint64_t maxStack;                  // deepest the operand stack gets above the locals
+
+    // calls so far, and the machine code once the function got hot (a JitEntry, see jitc.h)
+    uint64_t calls;
+    void* jitEntry;
+
+    // what the body does besides computing a value from the arguments, filled in for --memo (see memoc.h)
+    struct Purity* purity;
+
+    // builtins are implemented in C: called with the argument values, returns the result
+    uint64_t (*native)(struct Interpreter* interpreter, uint64_t* arguments);
+} Function;
+
+typedef struct Statement {
+    uint32_t kind;
+    uint32_t offset;                    // where the statement starts in the program
+    uint64_t symbol;                    // interned id of the variable assigned, also its index into the globals
+    uint8_t scope;                      // where the variable assigned lives
+    uint32_t slot;
+    Expression* expression;             // value assigned or returned, condition of if / while, or the call
+    Block body;                         // body of if / while
+    Block elseBody;
+    Function* function;                 // function declared
+
+    // filled in by the optimizer
+    uint32_t shape;
+    uint64_t step;                      // SHAPE_INCREMENT: added to the variable
+    Expression* operand;                // SHAPE_ACCUMULATE: added to the variable
+    bool loopCalls;                     // SHAPE_COUNTED: the body makes calls
+} Statement;
+
+// every node lives in an arena: a function's body in the interpreter's, which goes away with it, and
+// a top-level statement in the statement arena, which is reset once the statement has run
+
+Expression* expressionConstructor(Arena* arena, uint32_t kind, uint32_t offset) {
+    Expression* expression = (Expression*) (arenaCalloc(arena, sizeof(Expression)));
+    expression -> kind = kind;
+    expression -> offset = offset;
+    return expression;
+}
+
+Statement* statementConstructor(Arena* arena, uint32_t kind, uint32_t offset) {
+    Statement* statement = (Statement*) (arenaCalloc(arena, sizeof(Statement)));
+    statement -> kind = kind;
+    statement -> offset = offset;
+    return statement;
+}
+
+void blockAppend(Arena* arena, Block* block, Statement* statement) {
+    if (block -> length == block -> capacity) {
+        uint64_t capacity = (block -> capacity == 0) ? 4 : block -> capacity * 2;
+        block -> statements = (Statement**) (arenaRealloc(arena, block -> statements,
+            sizeof(Statement*) * block -> capacity, sizeof(Statement*) * capacity));
+        block -> capacity = capacity;
+    }
+    block -> statements[block -> length++] = statement;
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Implementation includes
+#include "interpreterc.h"
+#include "vmc.h"
+#include "inputc.h"
+
+// Runs many programs in one process (--batch): a pool of worker threads takes
+// the programs in turn, each with an Interpreter of its own, and captures what
+// it prints. The main thread writes the captured output of every program in
+// the order they were given, as soon as that program and all before it are
+// done, each after a "==> name <==" line.
+//
+// A program that fails does not end the process: the failure comes back
+// through the parser's recover point, its message goes into that program's
+// output, and the batch carries on. Nothing in the interpreter is shared
+// between threads, so the workers need no locking except to take tasks.
+
+// the C stack of every worker, unless the process's stack limit is larger
+#define BATCH_STACK_SIZE (8 * 1024 * 1024)
+
+// how a program is run, the same for all of them
+typedef struct EngineOptions {
+    bool useVm;                         // --vm
+    bool jit;                           // no --no-jit
+    bool optimize;                      // no --no-optimize
+    uint64_t memoSize;                  // --memo / --memo-size, 0 without
+    uint64_t maxDepth;                  // --max-depth, 0 for the default
+    char const* cacheDirectory;         // --cache, or NULL
+} EngineOptions;
+
+typedef struct BatchTask {
+    char const* fileName;
+    char* output;                       // what the program printed (malloc'd), and its length
+    uint64_t length;
+    bool failed;
+    bool done;
+} BatchTask;
+
+typedef struct Batch {
+    BatchTask* tasks;
+    uint64_t numTasks;
+    uint64_t next;                      // the first task no worker has taken
+    EngineOptions* options;
+    uint64_t stackSize;
+    pthread_mutex_t lock;
+    pthread_cond_t finished;            // signalled whenever a task is done
+} Batch;
+
+// applies the options to a new interpreter
+void engineConfigure(Interpreter* interpreter, EngineOptions* options) {
+    if (options -> maxDepth != 0) {
+        interpreter -> maxDepth = options -> maxDepth;
+    }
+    if (!options -> optimize) {
+        interpreter -> optimizer.enabled = false;
+    }
+    if (options -> memoSize > 0) {
+        memoEnable(&(interpreter -> memo), options -> memoSize);
+    }
+    if (!options -> jit) {
+        interpreter -> jit.enabled = false;
+    }
+}
+
+// appends a line to the task's output
+void batchMessage(BatchTask* task, char const* message, char const* detail) {
+    size_t length = strlen(message) + strlen(detail) + 4;
+    task -> output = (char*) (realloc(task -> output, task -> length + length));
+    task -> length += snprintf(task -> output + task -> length, length, "%s: %s\n", message, detail);
+}
+
+// runs one program on this thread, leaving its output in the task
+void batchRun(BatchTask* task, EngineOptions* options, uint64_t stackSize) {
+    int fd = open(task -> fileName, O_RDONLY);
+    struct stat stats;
+    int error = (fd < 0 || fstat(fd, &stats) != 0) ? errno : S_ISDIR(stats.st_mode) ? EISDIR : 0;
+    if (error != 0) {
+        batchMessage(task, task -> fileName, strerror(error));
+        task -> failed = true;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+
+    // a regular file is mapped, anything else read to the end first
+    bool mapped = S_ISREG(stats.st_mode) && stats.st_size > 0;
+    Input input;
+    char* prog;
+    if (mapped) {
+        prog = (char*) (mmap(0, stats.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+        if (prog == MAP_FAILED) {
+            batchMessage(task, task -> fileName, strerror(errno));
+            task -> failed = true;
+            close(fd);
+            return;
+        }
+    }
+    else {
+        inputConstructor(&input, fd);
+        inputReadAll(&input);
+        prog = input.buffer;
+    }
+    close(fd);
+
+    Interpreter* interpreter = interpreterConstructor(prog, options -> cacheDirectory, &stats);
+    outputCapture(&(interpreter -> output));
+    engineConfigure(interpreter, options);
+    interpreter -> cStackSize = stackSize;
+
+    // a failure anywhere in the run lands here instead of exiting
+    jmp_buf recover;
+    Vm* volatile vm = NULL;
+    interpreter -> parser.recover = &recover;
+    if (setjmp(recover) == 0) {
+        if (options -> useVm) {
+            vm = vmConstructor(interpreter);
+            runVm(vm);
+        }
+        else {
+            run(interpreter);
+        }
+    }
+    else {
+        interpreter -> parser.recover = NULL;
+        failureMessage(&(interpreter -> parser), interpreter -> parser.failedOffset);
+        task -> failed = true;
+    }
+    interpreter -> parser.recover = NULL;
+    if (vm != NULL) {
+        freeVm(vm);
+    }
+
+    // take the captured output before the interpreter goes
+    Output* output = &(interpreter -> output);
+    outputFlush(output);
+    task -> output = output -> captured;
+    task -> length = output -> capturedLength;
+    output -> captured = NULL;
+    freeInterpreter(interpreter);
+
+    if (mapped) {
+        munmap(prog, stats.st_size);
+    }
+    else {
+        freeInput(&input);
+    }
+}
+
+// a worker: runs tasks until there are none left
+void* batchWorker(void* argument) {
+    Batch* batch = (Batch*) argument;
+    while (true) {
+        pthread_mutex_lock(&(batch -> lock));
+        uint64_t i = batch -> next;
+        if (i < batch -> numTasks) {
+            batch -> next++;
+        }
+        pthread_mutex_unlock(&(batch -> lock));
+        if (i >= batch -> numTasks) {
+            return NULL;
+        }
+
+        BatchTask* task = &(batch -> tasks[i]);
+        batchRun(task, batch -> options, batch -> stackSize);
+
+        pthread_mutex_lock(&(batch -> lock));
+        task -> done = true;
+        pthread_cond_broadcast(&(batch -> finished));
+        pthread_mutex_unlock(&(batch -> lock));
+    }
+}
+
+// runs the programs on the given number of threads, writing their output to stdout in order.
+// Returns how many failed
+uint64_t runBatch(char const* const* fileNames, uint64_t numFiles, uint64_t numThreads, EngineOptions* options) {
+    Batch batch;
+    batch.tasks = (BatchTask*) (calloc(numFiles + 1, sizeof(BatchTask)));
+    batch.numTasks = numFiles;
+    batch.next = 0;
+    batch.options = options;
+    pthread_mutex_init(&(batch.lock), NULL);
+    pthread_cond_init(&(batch.finished), NULL);
+    for (uint64_t i = 0; i < numFiles; i++) {
+        batch.tasks[i].fileName = fileNames[i];
+    }
+
+    // the workers get as much stack as a program run on its own would
+    batch.stackSize = BATCH_STACK_SIZE;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur > BATCH_STACK_SIZE) {
+        batch.stackSize = limit.rlim_cur;
+    }
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, batch.stackSize);
+
+    if (numThreads > numFiles) {
+        numThreads = numFiles;
+    }
+    pthread_t* threads = (pthread_t*) (malloc(sizeof(pthread_t) * (numThreads + 1)));
+    for (uint64_t i = 0; i < numThreads; i++) {
+        int rc = pthread_create(&(threads[i]), &attributes, batchWorker, &batch);
+        if (rc != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(rc));
+            exit(1);
+        }
+    }
+    pthread_attr_destroy(&attributes);
+
+    // report each program once it and every one before it are done
+    Output out;
+    outputConstructor(&out, STDOUT_FILENO);
+    uint64_t failed = 0;
+    for (uint64_t i = 0; i < numFiles; i++) {
+        BatchTask* task = &(batch.tasks[i]);
+        pthread_mutex_lock(&(batch.lock));
+        while (!task -> done) {
+            pthread_cond_wait(&(batch.finished), &(batch.lock));
+        }
+        pthread_mutex_unlock(&(batch.lock));
+
+        outputString(&out, "==> ");
+        outputString(&out, task -> fileName);
+        outputString(&out, " <==\n");
+        if (task -> length > 0) {
+            outputBytes(&out, task -> output, task -> length);
+        }
+        outputFlush(&out);
+        free(task -> output);
+        failed += task -> failed ? 1 : 0;
+    }
+    freeOutput(&out);
+
+    for (uint64_t i = 0; i < numThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_cond_destroy(&(batch.finished));
+    pthread_mutex_destroy(&(batch.lock));
+    free(batch.tasks);
+    return failed;
+}
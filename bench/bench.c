@@ -0,0 +1,238 @@
+// wait4 and clock_gettime are not in plain C99
+#define _GNU_SOURCE
+
+// libc includes
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+// Runs every benchmark program a number of times with the interpreter and
+// reports, for each one, the median wall time, the peak resident set size and
+// how many statements per second it executed. The medians are compared with a
+// baseline file, and any benchmark that got slower by more than the threshold
+// makes the run fail.
+//
+//      bench [--runs <n>] [--threshold <percent>] [--baseline <file>] [--write-baseline]
+//            <interpreter> [<interpreter options>] -- <name>.fun ...
+//
+// The statement count comes from one extra run with --profile (the sum of
+// the statements column of its function table), so profiling does not slow
+// down the timed runs. The baseline file has one "<name> <median ms>" per line.
+
+#define MAX_ARGUMENTS 64
+#define MAX_BENCHMARKS 256
+
+typedef struct Result {
+    char const* name;
+    double medianMs;
+    long peakKb;
+    uint64_t statements;
+} Result;
+
+double nowMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+// runs the command with stdout (and stderr, if errors is -1) going to /dev/null, or stderr to errors.
+// Returns the wall time in ms, and the peak resident set size in KiB through peakKb
+double runOnce(char** command, int errors, long* peakKb) {
+    double start = nowMs();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2((errors < 0) ? null : errors, STDERR_FILENO);
+        execv(command[0], command);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+        exit(1);
+    }
+    double elapsed = nowMs() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        int last = 0;
+        while (command[last + 1] != NULL) {
+            last++;
+        }
+        fprintf(stderr, "%s failed on %s\n", command[0], command[last]);
+        exit(1);
+    }
+    *peakKb = usage.ru_maxrss;
+    return elapsed;
+}
+
+int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+// how many statements the program executes, from the function table --profile prints.
+// The count comes from the default engine, since --profile rejects --vm and -S
+uint64_t countStatements(char* interpreter, char* program) {
+    char* profiled[] = { interpreter, (char*) "--profile", program, NULL };
+    FILE* report = tmpfile();
+    long peakKb;
+    runOnce(profiled, fileno(report), &peakKb);
+
+    rewind(report);
+    char line[1024];
+    uint64_t statements = 0;
+    // skip the header, then add up until the blank line before the line table
+    if (fgets(line, sizeof(line), report) != NULL) {
+        while (fgets(line, sizeof(line), report) != NULL && line[0] != '\n') {
+            char name[512];
+            unsigned long calls;
+            unsigned long count;
+            if (sscanf(line, "%511s %lu %lu", name, &calls, &count) == 3) {
+                statements += count;
+            }
+        }
+    }
+    fclose(report);
+    return statements;
+}
+
+// the baseline median of the named benchmark, or a negative number if it has none
+double baselineMs(char const* baselineName, char const* name) {
+    FILE* baseline = fopen(baselineName, "r");
+    if (baseline == NULL) {
+        return -1;
+    }
+    char entry[512];
+    double ms;
+    double found = -1;
+    while (fscanf(baseline, "%511s %lf", entry, &ms) == 2) {
+        if (strcmp(entry, name) == 0) {
+            found = ms;
+        }
+    }
+    fclose(baseline);
+    return found;
+}
+
+// the file name without its directory and .fun
+char const* benchmarkName(char const* path) {
+    char const* slash = strrchr(path, '/');
+    char const* start = (slash == NULL) ? path : slash + 1;
+    char* name = strdup(start);
+    char* dot = strrchr(name, '.');
+    if (dot != NULL) {
+        *dot = 0;
+    }
+    return name;
+}
+
+int main(int argc, char** argv) {
+    int runs = 5;
+    double threshold = 10;
+    char const* baselineName = "bench/baseline.txt";
+    bool writeBaseline = false;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baselineName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--write-baseline") == 0) {
+            writeBaseline = true;
+        }
+        else {
+            break;
+        }
+    }
+
+    // the interpreter and its options, up to --, then the programs
+    char* command[MAX_ARGUMENTS];
+    int length = 0;
+    for (; i < argc && strcmp(argv[i], "--") != 0 && length < MAX_ARGUMENTS - 2; i++) {
+        command[length++] = argv[i];
+    }
+    i++;
+    if (length == 0 || i >= argc || runs < 1) {
+        fprintf(stderr, "usage: %s [--runs <n>] [--threshold <percent>] [--baseline <file>] [--write-baseline] "
+            "<interpreter> [<options>] -- <name>.fun ...\n", argv[0]);
+        exit(1);
+    }
+
+    Result results[MAX_BENCHMARKS];
+    int numResults = 0;
+    int regressions = 0;
+    double* times = (double*) (malloc(sizeof(double) * runs));
+
+    printf("%-12s %12s %12s %16s %12s %9s\n", "benchmark", "median ms", "peak KiB", "statements/s", "baseline ms", "change");
+    for (; i < argc && numResults < MAX_BENCHMARKS; i++) {
+        Result* result = &(results[numResults++]);
+        result -> name = benchmarkName(argv[i]);
+        command[length] = argv[i];
+        command[length + 1] = NULL;
+
+        result -> peakKb = 0;
+        for (int run = 0; run < runs; run++) {
+            long peakKb;
+            times[run] = runOnce(command, -1, &peakKb);
+            if (peakKb > result -> peakKb) {
+                result -> peakKb = peakKb;
+            }
+        }
+        qsort(times, runs, sizeof(double), compareDoubles);
+        result -> medianMs = (runs % 2 == 1) ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2;
+        result -> statements = countStatements(command[0], argv[i]);
+
+        double perSecond = result -> statements / (result -> medianMs / 1e3);
+        double baseline = baselineMs(baselineName, result -> name);
+        printf("%-12s %12.1f %12ld %16.0f", result -> name, result -> medianMs, result -> peakKb, perSecond);
+        if (baseline <= 0) {
+            printf(" %12s %9s\n", "-", "-");
+            continue;
+        }
+        double change = (result -> medianMs - baseline) / baseline * 100;
+        bool regressed = change > threshold;
+        printf(" %12.1f %+8.1f%%%s\n", baseline, change, regressed ? "  REGRESSION" : "");
+        regressions += regressed ? 1 : 0;
+    }
+    free(times);
+
+    if (writeBaseline) {
+        FILE* baseline = fopen(baselineName, "w");
+        if (baseline == NULL) {
+            perror(baselineName);
+            exit(1);
+        }
+        for (int r = 0; r < numResults; r++) {
+            fprintf(baseline, "%s %.1f\n", results[r].name, results[r].medianMs);
+        }
+        fclose(baseline);
+        printf("wrote %s\n", baselineName);
+        return 0;
+    }
+    if (regressions > 0) {
+        printf("%d benchmark(s) more than %.0f%% slower than %s\n", regressions, threshold, baselineName);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lexerc.h"
+
+// The tokens of a program, saved so that the next run of the same source
+// does not lex it again (--cache <directory>). A file is named after a hash
+// of the source's key, and holds
+//
+//      | header | tokens (Token[numTokens]) | symbols (CacheSymbol[numSymbols]) |
+//
+// The key of a regular file is what stat says about it (device, inode, size
+// and modification time), anything else (a pipe) has no such identity and is
+// keyed on a hash of what was read. The key only picks the file to try: the
+// header keeps the hash of the source the tokens were made from, and it must
+// match the source being run.
+//
+// The tokens already are position independent (offsets into the source,
+// interned ids, and for a { the index of its }), so a later run maps the file
+// and uses them where they are. Symbols are stored as offsets into the source
+// and turned back into slices.
+//
+// A file that does not match (another version or machine, a changed source,
+// a short write, flipped bits) is ignored, and the source is lexed and the
+// file written again. The parser also checks what a token points at where it
+// uses it (an identifier's id, the } of a function body, an offset in a
+// failure message), so even a file that gets past this is never followed out
+// of bounds.
+
+#define CACHE_MAGIC "FUNTOKS"
+#define CACHE_VERSION 4
+
+typedef struct CacheKey {
+    uint64_t device;                    // a regular file: st_dev, st_ino, st_size and st_mtim
+    uint64_t inode;
+    uint64_t size;
+    uint64_t modified;                  // (nanoseconds)
+    uint64_t sourceHash;                // anything else: a hash of the source, 0 for a regular file
+} CacheKey;
+
+typedef struct CacheHeader {
+    char magic[8];                      // CACHE_MAGIC
+    uint32_t version;                   // CACHE_VERSION, in this machine's byte order
+    uint32_t tokenSize;                 // sizeof(Token)
+    CacheKey key;
+    uint64_t sourceLength;
+    uint64_t sourceHash;                // of the source the tokens were made from
+    uint64_t numTokens;
+    uint64_t numSymbols;
+    uint64_t checksum;                  // of everything after the header
+} CacheHeader;
+
+typedef struct CacheSymbol {
+    uint32_t offset;
+    uint32_t length;
+} CacheSymbol;
+
+// FNV-1a, eight bytes at a time, then the bytes that are left over
+uint64_t cacheHash(char const* bytes, uint64_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    uint64_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    for (; i < length; i++) {
+        hash = (hash ^ (uint8_t) bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// the key of the program: source is what it was read from, NULL (or not a regular file) to key it on its bytes
+void cacheKeyConstructor(CacheKey* key, struct stat const* source, char const* program, uint64_t length) {
+    memset(key, 0, sizeof(CacheKey));
+    if (source != NULL && S_ISREG(source -> st_mode)) {
+        key -> device = (uint64_t) source -> st_dev;
+        key -> inode = (uint64_t) source -> st_ino;
+        key -> size = (uint64_t) source -> st_size;
+        key -> modified = (uint64_t) source -> st_mtim.tv_sec * 1000000000 + (uint64_t) source -> st_mtim.tv_nsec;
+    }
+    else {
+        key -> sourceHash = cacheHash(program, length);
+    }
+}
+
+// the hash of the source the header keeps
+uint64_t cacheSourceHash(CacheKey* key, char const* program, uint64_t length) {
+    return (key -> sourceHash != 0) ? key -> sourceHash : cacheHash(program, length);
+}
+
+// <directory>/<hash of the key>.tokens, to be free'd by the caller
+char* cachePath(char const* directory, CacheKey* key) {
+    size_t length = strlen(directory) + 32;
+    char* path = (char*) (malloc(length));
+    snprintf(path, length, "%s/%016llx.tokens", directory,
+        (unsigned long long) cacheHash((char const*) key, sizeof(CacheKey)));
+    return path;
+}
+
+// checks everything the lexer and parser rely on, so a bad file can only be ignored, never followed
+bool cacheValid(CacheHeader* header, uint64_t fileSize, CacheKey* key, char const* program, uint64_t length) {
+    if (fileSize < sizeof(CacheHeader) || memcmp(header -> magic, CACHE_MAGIC, sizeof(header -> magic)) != 0 ||
+            header -> version != CACHE_VERSION || header -> tokenSize != sizeof(Token) ||
+            memcmp(&(header -> key), key, sizeof(CacheKey)) != 0 || header -> sourceLength != length ||
+            header -> sourceHash != cacheSourceHash(key, program, length)) {
+        return false;
+    }
+    // (the counts are checked one at a time so the sizes cannot overflow)
+    uint64_t body = fileSize - sizeof(CacheHeader);
+    if (header -> numTokens == 0 || header -> numTokens > body / sizeof(Token) ||
+            header -> numSymbols > body / sizeof(CacheSymbol) ||
+            header -> numTokens * sizeof(Token) + header -> numSymbols * sizeof(CacheSymbol) != body) {
+        return false;
+    }
+    if (cacheHash((char const*) (header + 1), body) != header -> checksum) {
+        return false;
+    }
+
+    Token* tokens = (Token*) (header + 1);
+    for (uint64_t i = 0; i < header -> numTokens; i++) {
+        if (tokens[i].kind > TOKEN_OR || tokens[i].offset > length ||
+                (tokens[i].kind == TOKEN_IDENTIFIER && tokens[i].value >= header -> numSymbols) ||
+                (tokens[i].kind == TOKEN_LEFT_BRACE && tokens[i].value >= header -> numTokens)) {
+            return false;
+        }
+    }
+    if (tokens[header -> numTokens - 1].kind != TOKEN_END) {
+        return false;
+    }
+    CacheSymbol* symbols = (CacheSymbol*) (tokens + header -> numTokens);
+    for (uint64_t i = 0; i < header -> numSymbols; i++) {
+        if (symbols[i].length == 0 || (uint64_t) symbols[i].offset + symbols[i].length > length ||
+                !isalpha(program[symbols[i].offset])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// fills a fresh lexer (lexerInit) from the cache file for the program, if there is a good one.
+// The tokens stay in the mapped file until freeLexer
+bool cacheLoad(Lexer* lexer, char const* directory, CacheKey* key, char const* program, uint64_t length) {
+    char* path = cachePath(directory, key);
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat stats;
+    if (fstat(fd, &stats) != 0 || (uint64_t) stats.st_size < sizeof(CacheHeader)) {
+        close(fd);
+        return false;
+    }
+    uint64_t size = (uint64_t) stats.st_size;
+    void* mapping = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    CacheHeader* header = (CacheHeader*) mapping;
+    if (!cacheValid(header, size, key, program, length)) {
+        munmap(mapping, size);
+        return false;
+    }
+
+    // the ids must come out as they did when the file was written, each symbol a new one
+    Token* tokens = (Token*) (header + 1);
+    CacheSymbol* symbols = (CacheSymbol*) (tokens + header -> numTokens);
+    for (uint64_t i = 0; i < header -> numSymbols; i++) {
+        lexerIntern(lexer, sliceConstructorLen(program + symbols[i].offset, symbols[i].length));
+    }
+    if (lexer -> numSymbols != header -> numSymbols) {
+        Arena* arena = lexer -> symbolIds -> arena;
+        freeMap(lexer -> symbolIds);
+        lexer -> symbolIds = mapCreate(arena);
+        lexer -> numSymbols = 0;
+        munmap(mapping, size);
+        return false;
+    }
+
+    free(lexer -> tokens);
+    lexer -> tokens = tokens;
+    lexer -> numTokens = header -> numTokens;
+    lexer -> tokenCapacity = header -> numTokens;
+    lexer -> mapping = mapping;
+    lexer -> mappingSize = size;
+    return true;
+}
+
+// writes the lexer's tokens and symbols for the next run; does nothing if it cannot.
+// The file is written under a temporary name (one per process and lexer) and renamed, so no run sees half of it
+void cacheStore(Lexer* lexer, char const* directory, CacheKey* key, char const* program, uint64_t length) {
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.tokenSize = sizeof(Token);
+    header.key = *key;
+    header.sourceLength = length;
+    header.sourceHash = cacheSourceHash(key, program, length);
+    header.numTokens = lexer -> numTokens;
+    header.numSymbols = lexer -> numSymbols;
+
+    uint64_t tokenBytes = sizeof(Token) * lexer -> numTokens;
+    uint64_t bodySize = tokenBytes + sizeof(CacheSymbol) * lexer -> numSymbols;
+    char* body = (char*) (malloc(bodySize));
+    memcpy(body, lexer -> tokens, tokenBytes);
+    CacheSymbol* symbols = (CacheSymbol*) (body + tokenBytes);
+    for (uint64_t i = 0; i < lexer -> numSymbols; i++) {
+        symbols[i].offset = (uint32_t) (lexer -> symbols[i].start - program);
+        symbols[i].length = (uint32_t) lexer -> symbols[i].len;
+    }
+    header.checksum = cacheHash(body, bodySize);
+
+    char* path = cachePath(directory, key);
+    size_t temporaryLength = strlen(path) + 64;
+    char* temporary = (char*) (malloc(temporaryLength));
+    snprintf(temporary, temporaryLength, "%s.%ld.%lx", path, (long) getpid(), (unsigned long) (uintptr_t) lexer);
+    FILE* file = fopen(temporary, "wb");
+    if (file != NULL) {
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(body, 1, bodySize, file) == bodySize;
+        written = (fclose(file) == 0) && written;
+        if (!written || rename(temporary, path) != 0) {
+            unlink(temporary);
+        }
+    }
+    free(temporary);
+    free(path);
+    free(body);
+}
@@ -0,0 +1,725 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Implementation includes
+#include "interpreterc.h"
+
+// The ahead-of-time compiler (-S): turns the whole program into x86-64
+// assembly (AT&T syntax) on stdout, to be linked with
+//
+//      gcc -o prog.run -static prog.s
+//
+// It reads the program with the same lexer, parser and resolver as the
+// interpreter, and the compiled program behaves the same way: functions exist
+// once their declaration has run, a syntax error fails when execution reaches
+// it (inside a function body, when the function is called), and runtime errors
+// print the same "failed at offset" message.
+//
+// Every Fun function is a native function. The caller pushes the arguments
+// left to right and calls through the function table, the result comes back
+// in %rax. Parameters are read where the caller left them, locals get stack
+// slots below %rbp, each with a flag telling whether it has been assigned.
+//
+//      frame:  | arg 0 | ... | arg n-1 | return address | saved rbp | locals | local flags | temporaries
+//                                                                  ^ rbp
+//
+// Expressions are evaluated into %rax, with the left operand of a binary
+// operator saved on the stack while the right one is evaluated (unless the right
+// one can be loaded straight into %rcx). Globals, their defined flags and the
+// function table are arrays indexed by the interned id of the name.
+
+// the runtime every compiled program carries: buffered output (print), failures and the stack limit
+static const char* const compilerRuntime =
+    "    .text\n"
+    "# appends the byte in %dil to the output buffer\n"
+    "fun_put:\n"
+    "    mov fun_out_len(%rip), %rax\n"
+    "    cmp $65536, %rax\n"
+    "    jb 1f\n"
+    "    push %rdi\n"
+    "    call fun_flush\n"
+    "    pop %rdi\n"
+    "    xor %eax, %eax\n"
+    "1:  lea fun_out(%rip), %rcx\n"
+    "    mov %dil, (%rcx,%rax)\n"
+    "    inc %rax\n"
+    "    mov %rax, fun_out_len(%rip)\n"
+    "    ret\n"
+    "\n"
+    "# writes out the output buffer\n"
+    "fun_flush:\n"
+    "    push %rbx\n"
+    "    push %r12\n"
+    "    push %r13\n"
+    "    mov %rsp, %rbx\n"
+    "    and $-16, %rsp\n"
+    "    lea fun_out(%rip), %r12\n"
+    "    mov fun_out_len(%rip), %r13\n"
+    "1:  test %r13, %r13\n"
+    "    jz 2f\n"
+    "    mov $1, %edi\n"
+    "    mov %r12, %rsi\n"
+    "    mov %r13, %rdx\n"
+    "    call write\n"
+    "    test %rax, %rax\n"
+    "    jle 2f\n"
+    "    add %rax, %r12\n"
+    "    sub %rax, %r13\n"
+    "    jmp 1b\n"
+    "2:  movq $0, fun_out_len(%rip)\n"
+    "    mov %rbx, %rsp\n"
+    "    pop %r13\n"
+    "    pop %r12\n"
+    "    pop %rbx\n"
+    "    ret\n"
+    "\n"
+    "# appends the value in %rdi in decimal and a newline\n"
+    "fun_line:\n"
+    "    push %rbx\n"
+    "    push %r12\n"
+    "    sub $40, %rsp\n"
+    "    lea 32(%rsp), %r12\n"
+    "    lea 31(%rsp), %rbx\n"
+    "    movb $10, (%rbx)\n"
+    "    mov %rdi, %rax\n"
+    "    mov $10, %ecx\n"
+    "1:  xor %edx, %edx\n"
+    "    div %rcx\n"
+    "    add $48, %edx\n"
+    "    dec %rbx\n"
+    "    mov %dl, (%rbx)\n"
+    "    test %rax, %rax\n"
+    "    jnz 1b\n"
+    "2:  movzbl (%rbx), %edi\n"
+    "    call fun_put\n"
+    "    inc %rbx\n"
+    "    cmp %r12, %rbx\n"
+    "    jb 2b\n"
+    "    cmpb $0, fun_tty(%rip)\n"
+    "    je 3f\n"
+    "    call fun_flush\n"
+    "3:  add $40, %rsp\n"
+    "    pop %r12\n"
+    "    pop %rbx\n"
+    "    ret\n"
+    "\n"
+    "# appends the zero terminated string at %rdi\n"
+    "fun_string:\n"
+    "    push %rbx\n"
+    "    mov %rdi, %rbx\n"
+    "1:  movzbl (%rbx), %edi\n"
+    "    test %edi, %edi\n"
+    "    jz 2f\n"
+    "    call fun_put\n"
+    "    inc %rbx\n"
+    "    jmp 1b\n"
+    "2:  pop %rbx\n"
+    "    ret\n"
+    "\n"
+    "# the builtin print(value), a Fun function like any other\n"
+    "fun_print:\n"
+    "    mov 8(%rsp), %rdi\n"
+    "    call fun_line\n"
+    "    xor %eax, %eax\n"
+    "    ret\n"
+    "\n"
+    "# prints the failure at program offset %rdi after everything printed so far, and exits\n"
+    "fun_fail:\n"
+    "    mov %rdi, %r12\n"
+    "    lea fun_failed_text(%rip), %rdi\n"
+    "    call fun_string\n"
+    "    mov %r12, %rdi\n"
+    "    call fun_line\n"
+    "    lea fun_program(%rip), %rdi\n"
+    "    add %r12, %rdi\n"
+    "    call fun_string\n"
+    "    mov $10, %edi\n"
+    "    call fun_put\n"
+    "    call fun_flush\n"
+    "    and $-16, %rsp\n"
+    "    mov $1, %edi\n"
+    "    call exit\n"
+    "\n";
+
+typedef struct Compiler {
+    Interpreter* interpreter;
+    Output* out;                        // where the assembly goes
+    uint64_t numLabels;
+
+    // every function declared so far, fun_f<i> is the code of functions[i]
+    Function** functions;
+    uint64_t numFunctions;
+    uint64_t functionCapacity;
+
+    // .Lfail<i> fails at failOffsets[i]
+    uint64_t* failOffsets;
+    uint64_t numFails;
+    uint64_t failCapacity;
+
+    // the function being compiled (NULL for the top-level code)
+    Function* function;
+    uint64_t returnLabel;
+    uint64_t bodyLabel;                 // where a tail call of the function to itself starts over
+} Compiler;
+
+// writes one line of assembly, indented like an instruction
+void asmLine(Compiler* compiler, char const* format, ...) {
+    char line[256];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(line, sizeof(line), format, arguments);
+    va_end(arguments);
+    outputBytes(compiler -> out, "    ", 4);
+    outputBytes(compiler -> out, line, (uint64_t) length);
+    outputBytes(compiler -> out, "\n", 1);
+}
+
+void asmLabel(Compiler* compiler, char const* format, ...) {
+    char line[256];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(line, sizeof(line), format, arguments);
+    va_end(arguments);
+    outputBytes(compiler -> out, line, (uint64_t) length);
+    outputBytes(compiler -> out, ":\n", 2);
+}
+
+uint64_t newLabel(Compiler* compiler) {
+    return compiler -> numLabels++;
+}
+
+// a stub that fails at the given program offset, returns its number for .Lfail<n>
+uint64_t newFail(Compiler* compiler, uint64_t offset) {
+    if (compiler -> numFails == compiler -> failCapacity) {
+        compiler -> failCapacity = (compiler -> failCapacity == 0) ? 64 : compiler -> failCapacity * 2;
+        compiler -> failOffsets = (uint64_t*) (realloc(compiler -> failOffsets, sizeof(uint64_t) * compiler -> failCapacity));
+    }
+    compiler -> failOffsets[compiler -> numFails] = checkedOffset(&(compiler -> interpreter -> parser), offset);
+    return compiler -> numFails++;
+}
+
+// loads a constant into the given 64-bit register
+void asmConstant(Compiler* compiler, uint64_t value, char const* reg64, char const* reg32) {
+    if (value <= 0xffffffff) {
+        asmLine(compiler, "mov $%lu, %s", value, reg32);
+    }
+    else {
+        asmLine(compiler, "movabsq $%lu, %s", value, reg64);
+    }
+}
+
+// where a parameter or local of the function being compiled lives
+void slotOperand(Compiler* compiler, uint64_t slot, char* operand) {
+    Function* function = compiler -> function;
+    if (slot < function -> numParams) {
+        sprintf(operand, "%lu(%%rbp)", 16 + 8 * (function -> numParams - 1 - slot));
+    }
+    else {
+        sprintf(operand, "-%lu(%%rbp)", 8 * (slot - function -> numParams + 1));
+    }
+}
+
+// where the flag telling whether a local has been assigned lives
+void flagOperand(Compiler* compiler, uint64_t slot, char* operand) {
+    Function* function = compiler -> function;
+    uint64_t numLocals = function -> frameSize - function -> numParams;
+    sprintf(operand, "-%lu(%%rbp)", 8 * (numLocals + slot - function -> numParams + 1));
+}
+
+// an operand the expression can be read from without computing anything, or false
+bool simpleOperand(Compiler* compiler, Expression* expression, char* operand) {
+    if (expression -> kind != EXPRESSION_VARIABLE || expression -> scope == SCOPE_LOCAL) {
+        return false;
+    }
+    if (expression -> scope == SCOPE_PARAMETER) {
+        slotOperand(compiler, expression -> slot, operand);
+    }
+    else {
+        sprintf(operand, "fun_globals+%lu(%%rip)", 8 * expression -> symbol);
+    }
+    return true;
+}
+
+void compileAsmExpression(Compiler* compiler, Expression* expression);
+
+// evaluates a call into %rax, checking the same things in the same order as the tree walker
+void compileAsmCall(Compiler* compiler, Expression* call) {
+    Function* function = compiler -> function;
+    uint64_t missing = newFail(compiler, missingFunctionOffset(&(compiler -> interpreter -> parser), call));
+    uint64_t fail = newFail(compiler, call -> end);
+    uint64_t entry = 8 * call -> symbol;
+
+    if (call -> position == CALL_TAIL && call -> numArguments == function -> numParams) {
+        // return f(...) with as many arguments as the running function has parameters:
+        // overwrite the parameters and jump to f, which then returns straight to our caller
+        bool self = (call -> symbol == function -> symbol);
+        if (!self) {
+            asmLine(compiler, "cmpq $0, fun_functions+%lu(%%rip)", entry);
+            asmLine(compiler, "je .Lfail%lu", missing);
+        }
+        for (uint64_t i = 0; i < call -> numArguments; i++) {
+            compileAsmExpression(compiler, call -> arguments[i]);
+            asmLine(compiler, "push %%rax");
+        }
+        if (!self) {
+            asmLine(compiler, "cmpq $%lu, fun_arity+%lu(%%rip)", (uint64_t) call -> numArguments, entry);
+            asmLine(compiler, "jne .Lfail%lu", fail);
+        }
+        char operand[64];
+        for (uint64_t i = call -> numArguments; i > 0; i--) {
+            asmLine(compiler, "pop %%rax");
+            slotOperand(compiler, i - 1, operand);
+            asmLine(compiler, "mov %%rax, %s", operand);
+        }
+        if (self) {
+            // start over in the same frame
+            asmLine(compiler, "jmp .L%lu", compiler -> bodyLabel);
+        }
+        else {
+            asmLine(compiler, "leave");
+            asmLine(compiler, "jmp *fun_functions+%lu(%%rip)", entry);
+        }
+        return;
+    }
+
+    asmLine(compiler, "cmpq $0, fun_functions+%lu(%%rip)", entry);
+    asmLine(compiler, "je .Lfail%lu", missing);
+    asmConstant(compiler, compiler -> interpreter -> maxDepth, "%rcx", "%ecx");
+    asmLine(compiler, "cmp %%rcx, fun_depth(%%rip)");
+    asmLine(compiler, "jae .Lfail%lu", fail);
+    asmLine(compiler, "cmp fun_stack_limit(%%rip), %%rsp");
+    asmLine(compiler, "jb .Lfail%lu", fail);
+
+    for (uint64_t i = 0; i < call -> numArguments; i++) {
+        compileAsmExpression(compiler, call -> arguments[i]);
+        asmLine(compiler, "push %%rax");
+    }
+    asmLine(compiler, "cmpq $%lu, fun_arity+%lu(%%rip)", (uint64_t) call -> numArguments, entry);
+    asmLine(compiler, "jne .Lfail%lu", fail);
+
+    asmLine(compiler, "incq fun_depth(%%rip)");
+    asmLine(compiler, "call *fun_functions+%lu(%%rip)", entry);
+    asmLine(compiler, "decq fun_depth(%%rip)");
+    if (call -> numArguments > 0) {
+        asmLine(compiler, "add $%lu, %%rsp", 8 * (uint64_t) call -> numArguments);
+    }
+}
+
+// evaluates an expression into %rax
+void compileAsmExpression(Compiler* compiler, Expression* expression) {
+    char operand[64];
+
+    switch (expression -> kind) {
+        case EXPRESSION_LITERAL:
+            asmConstant(compiler, expression -> value, "%rax", "%eax");
+            return;
+
+        case EXPRESSION_VARIABLE:
+            if (expression -> scope == SCOPE_LOCAL) {
+                // utilize the local variable first, if no local variable, use global variable
+                uint64_t useGlobal = newLabel(compiler);
+                uint64_t end = newLabel(compiler);
+                flagOperand(compiler, expression -> slot, operand);
+                asmLine(compiler, "cmpq $0, %s", operand);
+                asmLine(compiler, "je .L%lu", useGlobal);
+                slotOperand(compiler, expression -> slot, operand);
+                asmLine(compiler, "mov %s, %%rax", operand);
+                asmLine(compiler, "jmp .L%lu", end);
+                asmLabel(compiler, ".L%lu", useGlobal);
+                asmLine(compiler, "mov fun_globals+%lu(%%rip), %%rax", 8 * expression -> symbol);
+                asmLabel(compiler, ".L%lu", end);
+                return;
+            }
+            simpleOperand(compiler, expression, operand);
+            asmLine(compiler, "mov %s, %%rax", operand);
+            return;
+
+        case EXPRESSION_CALL:
+            compileAsmCall(compiler, expression);
+            return;
+
+        case EXPRESSION_SHARE:
+            compileAsmExpression(compiler, expression -> left);
+            slotOperand(compiler, expression -> slot, operand);
+            asmLine(compiler, "mov %%rax, %s", operand);
+            return;
+
+        case EXPRESSION_NOT:
+        case EXPRESSION_TRUTH:
+            compileAsmExpression(compiler, expression -> left);
+            asmLine(compiler, "test %%rax, %%rax");
+            asmLine(compiler, (expression -> kind == EXPRESSION_NOT) ? "sete %%al" : "setne %%al");
+            asmLine(compiler, "movzbl %%al, %%eax");
+            return;
+    }
+
+    // binary operators: the left operand ends up in %rax, the right one in %rcx
+    compileAsmExpression(compiler, expression -> left);
+    Expression* right = expression -> right;
+    if (right -> kind == EXPRESSION_LITERAL) {
+        asmConstant(compiler, right -> value, "%rcx", "%ecx");
+    }
+    else if (simpleOperand(compiler, right, operand)) {
+        asmLine(compiler, "mov %s, %%rcx", operand);
+    }
+    else {
+        asmLine(compiler, "push %%rax");
+        compileAsmExpression(compiler, right);
+        asmLine(compiler, "mov %%rax, %%rcx");
+        asmLine(compiler, "pop %%rax");
+    }
+
+    char const* condition = NULL;
+    switch (expression -> kind) {
+        case EXPRESSION_MULTIPLY:
+            asmLine(compiler, "imul %%rcx, %%rax");
+            return;
+
+        case EXPRESSION_DIVIDE:
+        case EXPRESSION_MODULO: {
+            // division by zero gives 0
+            uint64_t zero = newLabel(compiler);
+            uint64_t end = newLabel(compiler);
+            asmLine(compiler, "test %%rcx, %%rcx");
+            asmLine(compiler, "jz .L%lu", zero);
+            asmLine(compiler, "xor %%edx, %%edx");
+            asmLine(compiler, "div %%rcx");
+            if (expression -> kind == EXPRESSION_MODULO) {
+                asmLine(compiler, "mov %%rdx, %%rax");
+            }
+            asmLine(compiler, "jmp .L%lu", end);
+            asmLabel(compiler, ".L%lu", zero);
+            asmLine(compiler, "xor %%eax, %%eax");
+            asmLabel(compiler, ".L%lu", end);
+            return;
+        }
+
+        case EXPRESSION_ADD:
+            asmLine(compiler, "add %%rcx, %%rax");
+            return;
+
+        case EXPRESSION_SUBTRACT:
+            asmLine(compiler, "sub %%rcx, %%rax");
+            return;
+
+        case EXPRESSION_AND:
+            asmLine(compiler, "test %%rax, %%rax");
+            asmLine(compiler, "setne %%al");
+            asmLine(compiler, "test %%rcx, %%rcx");
+            asmLine(compiler, "setne %%cl");
+            asmLine(compiler, "and %%cl, %%al");
+            asmLine(compiler, "movzbl %%al, %%eax");
+            return;
+
+        case EXPRESSION_OR:
+            asmLine(compiler, "or %%rcx, %%rax");
+            asmLine(compiler, "setne %%al");
+            asmLine(compiler, "movzbl %%al, %%eax");
+            return;
+
+        case EXPRESSION_LESS: condition = "b"; break;
+        case EXPRESSION_LESS_EQUAL: condition = "be"; break;
+        case EXPRESSION_GREATER: condition = "a"; break;
+        case EXPRESSION_GREATER_EQUAL: condition = "ae"; break;
+        case EXPRESSION_EQUAL: condition = "e"; break;
+        case EXPRESSION_NOT_EQUAL: condition = "ne"; break;
+    }
+
+    // comparisons are unsigned, like the values
+    asmLine(compiler, "cmp %%rcx, %%rax");
+    asmLine(compiler, "set%s %%al", condition);
+    asmLine(compiler, "movzbl %%al, %%eax");
+}
+
+void compileAsmStatement(Compiler* compiler, Statement* statement);
+
+void compileAsmBlock(Compiler* compiler, Block* block) {
+    for (uint64_t i = 0; i < block -> length; i++) {
+        compileAsmStatement(compiler, block -> statements[i]);
+    }
+}
+
+void compileAsmStatement(Compiler* compiler, Statement* statement) {
+    char operand[64];
+
+    switch (statement -> kind) {
+        case STATEMENT_ASSIGN: {
+            compileAsmExpression(compiler, statement -> expression);
+            uint64_t global = 8 * statement -> symbol;
+
+            if (statement -> scope == SCOPE_PARAMETER) {
+                slotOperand(compiler, statement -> slot, operand);
+                asmLine(compiler, "mov %%rax, %s", operand);
+            }
+            else if (statement -> scope == SCOPE_LOCAL) {
+                // the local if it exists, else the global if it exists, else a new local
+                uint64_t storeLocal = newLabel(compiler);
+                uint64_t end = newLabel(compiler);
+                flagOperand(compiler, statement -> slot, operand);
+                asmLine(compiler, "cmpq $0, %s", operand);
+                asmLine(compiler, "jne .L%lu", storeLocal);
+                asmLine(compiler, "cmpb $0, fun_defined+%lu(%%rip)", statement -> symbol);
+                asmLine(compiler, "je .L%lu", storeLocal);
+                asmLine(compiler, "mov %%rax, fun_globals+%lu(%%rip)", global);
+                asmLine(compiler, "jmp .L%lu", end);
+                asmLabel(compiler, ".L%lu", storeLocal);
+                asmLine(compiler, "movq $1, %s", operand);
+                slotOperand(compiler, statement -> slot, operand);
+                asmLine(compiler, "mov %%rax, %s", operand);
+                asmLabel(compiler, ".L%lu", end);
+            }
+            else {
+                asmLine(compiler, "mov %%rax, fun_globals+%lu(%%rip)", global);
+                asmLine(compiler, "movb $1, fun_defined+%lu(%%rip)", statement -> symbol);
+            }
+            return;
+        }
+
+        case STATEMENT_CALL:
+            compileAsmExpression(compiler, statement -> expression);
+            return;
+
+        case STATEMENT_IF: {
+            uint64_t otherwise = newLabel(compiler);
+            uint64_t end = newLabel(compiler);
+            compileAsmExpression(compiler, statement -> expression);
+            asmLine(compiler, "test %%rax, %%rax");
+            asmLine(compiler, "jz .L%lu", otherwise);
+            compileAsmBlock(compiler, &(statement -> body));
+            asmLine(compiler, "jmp .L%lu", end);
+            asmLabel(compiler, ".L%lu", otherwise);
+            compileAsmBlock(compiler, &(statement -> elseBody));
+            asmLabel(compiler, ".L%lu", end);
+            return;
+        }
+
+        case STATEMENT_WHILE: {
+            uint64_t top = newLabel(compiler);
+            uint64_t end = newLabel(compiler);
+            asmLabel(compiler, ".L%lu", top);
+            compileAsmExpression(compiler, statement -> expression);
+            asmLine(compiler, "test %%rax, %%rax");
+            asmLine(compiler, "jz .L%lu", end);
+            compileAsmBlock(compiler, &(statement -> body));
+            asmLine(compiler, "jmp .L%lu", top);
+            asmLabel(compiler, ".L%lu", end);
+            return;
+        }
+
+        case STATEMENT_RETURN:
+            compileAsmExpression(compiler, statement -> expression);
+            asmLine(compiler, "jmp .L%lu", compiler -> returnLabel);
+            return;
+
+        case STATEMENT_FUN: {
+            // the body is compiled after the top-level code, the declaration only makes it callable
+            Function* function = statement -> function;
+            if (compiler -> numFunctions == compiler -> functionCapacity) {
+                compiler -> functionCapacity = (compiler -> functionCapacity == 0) ? 16 : compiler -> functionCapacity * 2;
+                compiler -> functions = (Function**) (realloc(compiler -> functions, sizeof(Function*) * compiler -> functionCapacity));
+            }
+            compiler -> functions[compiler -> numFunctions] = function;
+            asmLine(compiler, "lea fun_f%lu(%%rip), %%rax", compiler -> numFunctions++);
+            asmLine(compiler, "mov %%rax, fun_functions+%lu(%%rip)", 8 * function -> symbol);
+            asmLine(compiler, "movq $%lu, fun_arity+%lu(%%rip)", function -> numParams, 8 * function -> symbol);
+            return;
+        }
+    }
+}
+
+// parses, resolves and compiles the body of the index-th function declared
+void compileAsmFunction(Compiler* compiler, uint64_t index) {
+    Function* function = compiler -> functions[index];
+    Parser* parser = &(compiler -> interpreter -> parser);
+    asmLabel(compiler, "fun_f%lu", index);
+
+    // a syntax error in the body only fails when the function is called
+    jmp_buf recover;
+    Token* resume = parser -> current;
+    parser -> recover = &recover;
+    if (setjmp(recover) != 0) {
+        parser -> current = resume;
+        parser -> recover = NULL;
+        asmLine(compiler, "mov $%lu, %%edi", parser -> failedOffset);
+        asmLine(compiler, "call fun_fail");
+        return;
+    }
+    prepareFunction(compiler -> interpreter, function);
+    parser -> recover = NULL;
+
+    compiler -> function = function;
+    compiler -> returnLabel = newLabel(compiler);
+    compiler -> bodyLabel = newLabel(compiler);
+    uint64_t numLocals = function -> frameSize - function -> numParams;
+
+    asmLine(compiler, "push %%rbp");
+    asmLine(compiler, "mov %%rsp, %%rbp");
+    if (numLocals > 0) {
+        // none of the locals exist yet
+        asmLine(compiler, "sub $%lu, %%rsp", 16 * numLocals);
+    }
+    asmLabel(compiler, ".L%lu", compiler -> bodyLabel);
+    if (numLocals > 0) {
+        char operand[64];
+        for (uint64_t slot = function -> numParams; slot < function -> frameSize; slot++) {
+            flagOperand(compiler, slot, operand);
+            asmLine(compiler, "movq $0, %s", operand);
+        }
+    }
+
+    compileAsmBlock(compiler, &(function -> body));
+
+    // if a return statement is never hit, the function returns 0
+    asmLine(compiler, "xor %%eax, %%eax");
+    asmLabel(compiler, ".L%lu", compiler -> returnLabel);
+    asmLine(compiler, "leave");
+    asmLine(compiler, "ret");
+    compiler -> function = NULL;
+}
+
+// the program text, so failures can print the rest of the program
+void compileAsmProgramText(Compiler* compiler) {
+    char const* program = compiler -> interpreter -> parser.program;
+    asmLabel(compiler, "fun_program");
+    char line[4 * 64 + 1];
+    uint64_t length = 0;
+    for (char const* p = program; *p != 0; p++) {
+        unsigned char c = (unsigned char) *p;
+        if (c == '"' || c == '\\') {
+            length += sprintf(line + length, "\\%c", c);
+        }
+        else if (c >= 32 && c < 127) {
+            line[length++] = (char) c;
+        }
+        else {
+            length += sprintf(line + length, "\\%03o", c);
+        }
+        if (length >= 4 * 60 || p[1] == 0) {
+            line[length] = 0;
+            asmLine(compiler, ".ascii \"%s\"", line);
+            length = 0;
+        }
+    }
+    asmLine(compiler, ".byte 0");
+}
+
+// compiles the whole program, writing the assembly to the interpreter's output
+void compileProgram(Interpreter* interpreter) {
+    Compiler* compiler = (Compiler*) (calloc(1, sizeof(Compiler)));
+    compiler -> interpreter = interpreter;
+    compiler -> out = &(interpreter -> output);
+    Parser* parser = &(interpreter -> parser);
+
+    outputString(compiler -> out, compilerRuntime);
+    asmLine(compiler, ".globl main");
+    asmLabel(compiler, "main");
+    asmLine(compiler, "push %%rbp");
+    asmLine(compiler, "mov %%rsp, %%rbp");
+    asmLine(compiler, "sub $16, %%rsp");
+    asmLine(compiler, "mov $1, %%edi");
+    asmLine(compiler, "call isatty");
+    asmLine(compiler, "mov %%al, fun_tty(%%rip)");
+
+    // fail cleanly before the stack runs out, like the tree walker
+    asmLine(compiler, "mov $%d, %%edi", RLIMIT_STACK);
+    asmLine(compiler, "mov %%rsp, %%rsi");
+    asmLine(compiler, "call getrlimit");
+    asmLine(compiler, "test %%eax, %%eax");
+    asmLine(compiler, "jnz 1f");
+    asmLine(compiler, "mov (%%rsp), %%rax");
+    asmLine(compiler, "cmp $-1, %%rax");
+    asmLine(compiler, "je 1f");
+    asmLine(compiler, "cmp $%d, %%rax", 2 * C_STACK_MARGIN);
+    asmLine(compiler, "jbe 1f");
+    asmLine(compiler, "mov %%rsp, %%rcx");
+    asmLine(compiler, "sub %%rax, %%rcx");
+    asmLine(compiler, "add $%d, %%rcx", C_STACK_MARGIN);
+    asmLine(compiler, "mov %%rcx, fun_stack_limit(%%rip)");
+    outputString(compiler -> out, "1:\n");
+
+    // builtins are runtime routines named after them
+    for (uint64_t symbol = 0; symbol < interpreter -> resolver.numGlobals; symbol++) {
+        Function* function = interpreter -> functions[symbol];
+        if (function != NULL && function -> native != NULL) {
+            asmLine(compiler, "lea fun_%.*s(%%rip), %%rax", (int) function -> name.len, function -> name.start);
+            asmLine(compiler, "mov %%rax, fun_functions+%lu(%%rip)", 8 * symbol);
+            asmLine(compiler, "movq $%lu, fun_arity+%lu(%%rip)", function -> numParams, 8 * symbol);
+        }
+    }
+
+    // the top-level statements in order, up to a syntax error if there is one
+    jmp_buf recover;
+    parser -> recover = &recover;
+    if (setjmp(recover) == 0) {
+        Statement* s;
+        while ((s = nextStatement(interpreter)) != NULL) {
+            compileAsmStatement(compiler, s);
+        }
+        parser -> recover = NULL;
+        asmLine(compiler, "call fun_flush");
+        asmLine(compiler, "and $-16, %%rsp");
+        asmLine(compiler, "xor %%edi, %%edi");
+        asmLine(compiler, "call exit");
+    }
+    else {
+        parser -> recover = NULL;
+        asmLine(compiler, "mov $%lu, %%edi", parser -> failedOffset);
+        asmLine(compiler, "call fun_fail");
+    }
+
+    for (uint64_t i = 0; i < compiler -> numFunctions; i++) {
+        compileAsmFunction(compiler, i);
+    }
+    for (uint64_t i = 0; i < compiler -> numFails; i++) {
+        asmLabel(compiler, ".Lfail%lu", i);
+        asmLine(compiler, "mov $%lu, %%edi", compiler -> failOffsets[i]);
+        asmLine(compiler, "call fun_fail");
+    }
+
+    // globals, their defined flags and the function table, by interned id
+    uint64_t numSymbols = interpreter -> parser.lexer.numSymbols;
+    asmLine(compiler, ".bss");
+    asmLine(compiler, ".align 16");
+    asmLabel(compiler, "fun_globals");
+    asmLine(compiler, ".zero %lu", 8 * numSymbols);
+    asmLabel(compiler, "fun_functions");
+    asmLine(compiler, ".zero %lu", 8 * numSymbols);
+    asmLabel(compiler, "fun_arity");
+    asmLine(compiler, ".zero %lu", 8 * numSymbols);
+    asmLabel(compiler, "fun_defined");
+    asmLine(compiler, ".zero %lu", numSymbols);
+    asmLine(compiler, ".align 16");
+    asmLabel(compiler, "fun_out");
+    asmLine(compiler, ".zero 65536");
+    asmLabel(compiler, "fun_out_len");
+    asmLine(compiler, ".zero 8");
+    asmLabel(compiler, "fun_depth");
+    asmLine(compiler, ".zero 8");
+    asmLabel(compiler, "fun_stack_limit");
+    asmLine(compiler, ".zero 8");
+    asmLabel(compiler, "fun_tty");
+    asmLine(compiler, ".zero 1");
+
+    asmLine(compiler, ".section .rodata");
+    asmLabel(compiler, "fun_failed_text");
+    asmLine(compiler, ".asciz \"failed at offset \"");
+    compileAsmProgramText(compiler);
+    asmLine(compiler, ".section .note.GNU-stack,\"\",@progbits");
+
+    free(compiler -> functions);
+    free(compiler -> failOffsets);
+    free(compiler);
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "slicec.h"
+#include "arenac.h"
+
+// One open-addressing hash table, stamped out for every value type that needs
+// a map from names (slices) to values:
+//
+//      DEFINE_HASH_MAP(MapType, prefix, freeName, ValueType, missingValue)
+//
+// defines the MapType struct and
+//
+//      MapType*  prefixCreate(Arena*)
+//      void      prefixInsert(MapType*, Slice key, ValueType value)
+//      ValueType prefixGet(MapType*, Slice key)       (missingValue if absent)
+//      bool      prefixContains(MapType*, Slice key)
+//      void      freeName(MapType*)
+//
+// The capacity is always a power of two, so a hash becomes a slot with a mask.
+// Collisions probe linearly to the next slot. The hash, key and value of each
+// entry live in three parallel arrays: a lookup scans only the hashes until it
+// finds an equal one, and growing the table reuses the stored hashes instead
+// of hashing every key again.
+//
+//      hashes:  | h0 | 0  | h2 | h3 | 0  | ... |     0 = empty slot
+//      keys:    | k0 |    | k2 | k3 |    | ... |
+//      values:  | v0 |    | v2 | v3 |    | ... |
+
+// the top bit marks a slot as used, so a stored hash is never 0
+#define HASH_MAP_USED ((uint64_t) 1 << 63)
+#define HASH_MAP_INITIAL_CAPACITY 16
+
+#define DEFINE_HASH_MAP(MapType, prefix, freeName, ValueType, missingValue)                             \
+                                                                                                        \
+typedef struct MapType {                                                                                \
+    uint64_t size;                                                                                      \
+    uint64_t mask;                      /* capacity - 1 */                                              \
+    uint64_t* hashes;                                                                                   \
+    Slice* keys;                                                                                        \
+    ValueType* values;                                                                                  \
+    /* the map and its arrays all live in this arena */                                                 \
+    Arena* arena;                                                                                       \
+} MapType;                                                                                              \
+                                                                                                        \
+void prefix##Allocate(MapType* map, uint64_t capacity) {                                                \
+    map -> mask = capacity - 1;                                                                         \
+    STAT_ADD(mapAllocs, 3);                                                                             \
+    map -> hashes = (uint64_t*) (arenaCalloc(map -> arena, sizeof(uint64_t) * capacity));              \
+    map -> keys = (Slice*) (arenaAlloc(map -> arena, sizeof(Slice) * capacity));                        \
+    map -> values = (ValueType*) (arenaAlloc(map -> arena, sizeof(ValueType) * capacity));              \
+}                                                                                                       \
+                                                                                                        \
+void prefix##Release(MapType* map) {                                                                    \
+    uint64_t capacity = map -> mask + 1;                                                                \
+    STAT_ADD(mapFrees, 3);                                                                              \
+    arenaFree(map -> arena, map -> hashes, sizeof(uint64_t) * capacity);                                \
+    arenaFree(map -> arena, map -> keys, sizeof(Slice) * capacity);                                     \
+    arenaFree(map -> arena, map -> values, sizeof(ValueType) * capacity);                               \
+}                                                                                                       \
+                                                                                                        \
+MapType* prefix##Create(Arena* arena) {                                                                 \
+    STAT_ADD(mapAllocs, 1);                                                                             \
+    MapType* map = (MapType*) (arenaAlloc(arena, sizeof(MapType)));                                     \
+    map -> size = 0;                                                                                    \
+    map -> arena = arena;                                                                               \
+    prefix##Allocate(map, HASH_MAP_INITIAL_CAPACITY);                                                   \
+    return map;                                                                                         \
+}                                                                                                       \
+                                                                                                        \
+/* the slot holding the key, or the empty slot where it would go */                                     \
+uint64_t prefix##Find(MapType* map, Slice key, uint64_t hash) {                                         \
+    uint64_t i = hash & map -> mask;                                                                    \
+    STAT_ADD(mapProbes, 1);                                                                             \
+    while (map -> hashes[i] != 0) {                                                                     \
+        if (map -> hashes[i] == hash && sliceEqualSlice(map -> keys[i], key)) {                         \
+            return i;                                                                                   \
+        }                                                                                               \
+        i = (i + 1) & map -> mask;                                                                      \
+        STAT_ADD(mapProbes, 1);                                                                         \
+    }                                                                                                   \
+    return i;                                                                                           \
+}                                                                                                       \
+                                                                                                        \
+/* doubles the capacity, moving every entry by the hash it already has */                               \
+void prefix##Expand(MapType* map) {                                                                     \
+    STAT_ADD(mapExpands, 1);                                                                            \
+    MapType old = *map;                                                                                 \
+    prefix##Allocate(map, (old.mask + 1) * 2);                                                          \
+    for (uint64_t i = 0; i <= old.mask; i++) {                                                          \
+        if (old.hashes[i] != 0) {                                                                       \
+            uint64_t j = old.hashes[i] & map -> mask;                                                   \
+            while (map -> hashes[j] != 0) {                                                             \
+                j = (j + 1) & map -> mask;                                                              \
+            }                                                                                           \
+            map -> hashes[j] = old.hashes[i];                                                           \
+            map -> keys[j] = old.keys[i];                                                               \
+            map -> values[j] = old.values[i];                                                           \
+        }                                                                                               \
+    }                                                                                                   \
+    prefix##Release(&old);                                                                              \
+}                                                                                                       \
+                                                                                                        \
+/* insert a key, value pair into the map, replacing the value if the key is already there */             \
+void prefix##Insert(MapType* map, Slice key, ValueType value) {                                         \
+    uint64_t hash = hashSlice(key) | HASH_MAP_USED;                                                     \
+    uint64_t i = prefix##Find(map, key, hash);                                                          \
+    if (map -> hashes[i] == 0) {                                                                        \
+        /* keep at least a quarter of the slots empty so probe runs stay short */                       \
+        if ((map -> size + 1) * 4 > (map -> mask + 1) * 3) {                                            \
+            prefix##Expand(map);                                                                        \
+            i = prefix##Find(map, key, hash);                                                           \
+        }                                                                                               \
+        map -> hashes[i] = hash;                                                                        \
+        map -> keys[i] = key;                                                                           \
+        map -> size++;                                                                                  \
+    }                                                                                                   \
+    map -> values[i] = value;                                                                           \
+}                                                                                                       \
+                                                                                                        \
+/* returns the value associated with the key in the map */                                              \
+ValueType prefix##Get(MapType* map, Slice key) {                                                        \
+    uint64_t i = prefix##Find(map, key, hashSlice(key) | HASH_MAP_USED);                                \
+    return (map -> hashes[i] != 0) ? map -> values[i] : (missingValue);                                 \
+}                                                                                                       \
+                                                                                                        \
+/* returns if the map contains the given key */                                                         \
+bool prefix##Contains(MapType* map, Slice key) {                                                        \
+    return map -> hashes[prefix##Find(map, key, hashSlice(key) | HASH_MAP_USED)] != 0;                  \
+}                                                                                                       \
+                                                                                                        \
+/* gives the map's memory back to its arena, so the next map can reuse it */                            \
+void freeName(MapType* map) {                                                                           \
+    prefix##Release(map);                                                                               \
+    STAT_ADD(mapFrees, 1);                                                                              \
+    arenaFree(map -> arena, map, sizeof(MapType));                                                      \
+}
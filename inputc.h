@@ -0,0 +1,134 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// A program read from a pipe, a terminal or anything else that cannot be
+// mapped, a block at a time. The text goes into one buffer that is reserved
+// up front and committed as it fills, so it never moves: slices and the
+// parser's program pointer stay valid while more text arrives. The buffer is
+// always NUL terminated after the last byte read. A mapped file goes
+// through an Input too (inputText), so it is lexed a piece at a time.
+//
+//      buffer:  | lexed ........ | read, not lexed yet | 0 | committed ... | reserved ...
+//               0                ^ lexed               ^ length
+
+// the whole reservation: token offsets are 32 bits, so no program can be longer anyway
+#define INPUT_RESERVE ((uint64_t) 1 << 32)
+#define INPUT_INITIAL_COMMIT (1024 * 1024)
+#define INPUT_LEX_CHUNK (64 * 1024)
+
+typedef struct Input {
+    int fd;
+    char* buffer;
+    uint64_t length;                    // bytes read so far
+    uint64_t committed;                 // bytes of the reservation that can be written
+    uint64_t lexed;                     // bytes the lexer has turned into tokens
+    bool ended;                         // the last read found the end of the input
+    bool lexedAll;                      // the lexer has seen the end of the program
+} Input;
+
+// makes room for at least one more byte and the NUL after it
+void inputGrow(Input* input) {
+    uint64_t committed = (input -> committed == 0) ? INPUT_INITIAL_COMMIT : input -> committed * 2;
+    if (committed > INPUT_RESERVE || mprotect(input -> buffer, committed, PROT_READ | PROT_WRITE) != 0) {
+        fprintf(stderr, "program too long\n");
+        exit(1);
+    }
+    input -> committed = committed;
+}
+
+void inputConstructor(Input* input, int fd) {
+    input -> fd = fd;
+    input -> buffer = (char*) (mmap(0, INPUT_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+    if (input -> buffer == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    input -> committed = 0;
+    input -> length = 0;
+    input -> lexed = 0;
+    input -> ended = false;
+    input -> lexedAll = false;
+    inputGrow(input);
+    input -> buffer[0] = 0;
+}
+
+// a program that is already all in memory (a mapped file): nothing is read, it is only lexed a piece
+// at a time. The text belongs to the caller, so there is nothing to free
+void inputText(Input* input, char* text, uint64_t length) {
+    input -> fd = -1;
+    input -> buffer = text;
+    input -> length = length;
+    input -> committed = 0;
+    input -> lexed = 0;
+    input -> ended = true;
+    input -> lexedAll = false;
+}
+
+// reads as much as one read(2) gives (at least a byte, unless the input ended), returns false at the end
+bool inputRead(Input* input) {
+    if (input -> ended) {
+        return false;
+    }
+    if (input -> length + 1 >= input -> committed) {
+        inputGrow(input);
+    }
+    ssize_t n;
+    do {
+        n = read(input -> fd, input -> buffer + input -> length, input -> committed - input -> length - 1);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        perror("read");
+        exit(1);
+    }
+    if (n == 0) {
+        input -> ended = true;
+        return false;
+    }
+    input -> length += n;
+    input -> buffer[input -> length] = 0;
+    return true;
+}
+
+// reads until the end of the input
+void inputReadAll(Input* input) {
+    while (inputRead(input)) {
+    }
+}
+
+// where the text read so far stops being sure to lex the same once more arrives: just past its last
+// newline (no token or comment goes on past the end of its line), or the end once the input ended.
+// At most about INPUT_LEX_CHUNK bytes are lexed at a time, so only the tokens near the running
+// statement are kept, however long the program is
+uint64_t inputLexable(Input* input) {
+    uint64_t end = input -> length;
+    if (end - input -> lexed > INPUT_LEX_CHUNK) {
+        end = input -> lexed + INPUT_LEX_CHUNK;
+    }
+    else if (input -> ended || end == input -> lexed) {
+        return end;
+    }
+    uint64_t lineEnd = end;
+    while (lineEnd > input -> lexed && input -> buffer[lineEnd - 1] != '\n') {
+        lineEnd--;
+    }
+    if (lineEnd > input -> lexed) {
+        return lineEnd;
+    }
+    // a line longer than a chunk
+    while (end < input -> length && input -> buffer[end - 1] != '\n') {
+        end++;
+    }
+    return (input -> buffer[end - 1] == '\n' || input -> ended) ? end : input -> lexed;
+}
+
+void freeInput(Input* input) {
+    munmap(input -> buffer, INPUT_RESERVE);
+}
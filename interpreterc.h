@@ -3,739 +3,671 @@
 // libc includes (available in both C and C++)
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 
 // Implementation includes
-#include "mapcfunction.h"
+#include "parserc.h"
+#include "resolverc.h"
+#include "optimizerc.h"
+#include "jitc.h"
+#include "memoc.h"
+#include "profilerc.h"
+#include "statsc.h"
 
-// optional -> allows one to check if a slice/int was returned/exists
-#define optional(type) struct { bool exists; type item; }
+// how many calls may be active at once, unless changed with --max-depth
+#define DEFAULT_MAX_DEPTH 100000
 
-typedef optional(Slice) optionalSlice;
-typedef optional(uint64_t) optionalInt;
+// room left on the C stack for everything below the deepest call
+#define C_STACK_MARGIN (256 * 1024)
 
 typedef struct Interpreter {
-    char* program;
-    char* current;
+    // owns the functions, their syntax trees and every map, all released together
+    Arena arena;
+    // the syntax tree of the top-level statement that is running, reset before the next one is parsed
+    Arena statementArena;
+    // buffered standard output
+    Output output;
+    Parser parser;
+    Resolver resolver;
+    Optimizer optimizer;
     optionalInt functionReturn;
-    UnorderedMap* currentSymbolTable;
-    UnorderedMap* symbolTable;
-    UnorderedFunctionMap* functionNameMap;
-} Interpreter;
 
-void fail(Interpreter* interpreter) {
-    printf("failed at offset %ld\n", (size_t)(interpreter -> current - interpreter -> program));
-    printf("%s\n", interpreter -> current);
-    exit(1);
-}
+    // global variables and declared functions, by the interned id of their names
+    uint64_t* globals;
+    bool* globalDefined;
+    Function** functions;               // NULL until a function of that name is declared
+    uint64_t globalCapacity;
+
+    // one contiguous stack for every active call: each call pushes a frame of
+    // frameSize slots (parameters then locals) and pops it on return.
+    // stackDefined tells whether the local in each slot has been assigned
+    uint64_t* stack;
+    bool* stackDefined;
+    uint64_t stackCapacity;
+    uint64_t stackTop;                  // first free slot
+    uint64_t frameBase;                 // first slot of the running function's frame
+    uint64_t depth;                     // number of active calls
+    uint64_t maxDepth;
+    uintptr_t cStackLimit;              // the tree walker fails before its C stack gets lower than this
+    uint64_t cStackSize;                // the size of the C stack it runs on (0: the process's stack limit)
+
+    // a call in tail position that is waiting for its caller's frame: the
+    // function, and the slot where its arguments were evaluated
+    Function* tailFunction;
+    uint64_t tailBase;
+    // machine code for hot functions
+    Jit jit;
+    // cached values of pure function calls (--memo)
+    Memo memo;
+    // time and counts per function and line (--profile)
+    Profiler profiler;
+
+    // parameters and locals of the running function, by slot (points into the stack)
+    uint64_t* locals;
+    bool* localDefined;
+} Interpreter;
 
-void endOrFail(Interpreter* interpreter) {
-    while (isspace(*(interpreter -> current))) {
-        interpreter -> current++;
-    }
-    if (*(interpreter -> current) != 0) {
-        fail(interpreter);
-    }
-}
+uint64_t functionCall(Interpreter* interpreter, Expression* call, Function* function);
+uint64_t tailCall(Interpreter* interpreter, Expression* call, Function* function);
+void checkCallSite(Interpreter* interpreter, Expression* call, Function* function);
 
-// skips past all white space
-void skip(Interpreter* interpreter) {
-    while (isspace(*(interpreter -> current))) {
-        interpreter -> current++;
+uint64_t variableValue(Interpreter* interpreter, Expression* expression) {
+    if (expression -> scope == SCOPE_PARAMETER ||
+            (expression -> scope == SCOPE_LOCAL && interpreter -> localDefined[expression -> slot])) {
+        // utilize the local variable first
+        return interpreter -> locals[expression -> slot];
     }
+    // if no local variable, use global variable
+    return interpreter -> globals[expression -> symbol];
 }
 
-// consumes to check if the current line matches str
-bool consume(Interpreter* interpreter, char const *str) {
-    skip(interpreter);
-
-    size_t i = 0;
-    while (true) {
-      char const expected = str[i];
-      char const found = interpreter -> current[i];
-      if (expected == 0) {
-        // survived to the end of the expected string 
-        interpreter -> current += i;
-        return true;
-      }
-      if (expected != found) {
+// can the right operand of && / || be left out: it has no calls, or every one of them reaches an
+// effect-free function with the right number of arguments that is sure to return (it can reach no
+// loop and no recursion) without going deeper than --max-depth
+bool rightSkippable(Interpreter* interpreter, Expression* expression) {
+    if (expression -> calls == NULL) {
         return false;
-      }
-      // assertion: found != 0
-      i++;
-    }
-}
-
-void consumeOrFail(Interpreter* interpreter, char const *str) {
-    if (!consume(interpreter, str)) {
-        fail(interpreter);
-    }
-}
-
-// consume a variable 
-optionalSlice consumeIdentifier(Interpreter* interpreter) {
-    skip(interpreter);
-
-    if (isalpha(*(interpreter -> current))) {
-        char const *start = interpreter -> current;
-
-        do {
-            interpreter -> current++;
-        } while(isalnum(*(interpreter -> current)));
-
-        optionalSlice slice = { true, sliceConstructorLen(start, (size_t)(interpreter -> current - start)) };
-        return slice;
     }
-    else {
-        optionalSlice slice = { false, sliceConstructorLen(0, 0) };
-        return slice;
+    for (Expression** calls = expression -> calls; *calls != NULL; calls++) {
+        Expression* call = *calls;
+        Function* function = interpreter -> functions[call -> symbol];
+        if (function == NULL || function -> numParams != call -> numArguments ||
+                hasEffects(&(interpreter -> memo), function, interpreter -> functions, interpreter -> globalDefined)) {
+            return false;
+        }
+        uint64_t depth = memoCallDepth(&(interpreter -> memo), function, interpreter -> functions);
+        if (depth == 0 || depth > interpreter -> maxDepth - interpreter -> depth) {
+            return false;
+        }
     }
+    return true;
 }
 
-// consume a number
-optionalInt consumeLiteral(Interpreter* interpreter) {
-    skip(interpreter);
-
-    if (isdigit(*(interpreter -> current))) {
-        uint64_t v = 0;
+// evaluates an expression tree, operands left to right
+uint64_t evaluate(Interpreter* interpreter, Expression* expression) {
+    STAT_ADD(expressions, 1);
+    switch (expression -> kind) {
+        case EXPRESSION_LITERAL:
+            return expression -> value;
 
-        do {
-            v = 10 * v + ((*(interpreter -> current)) - '0');
-            interpreter -> current++;
-        } while (isdigit(*(interpreter -> current)));
+        case EXPRESSION_VARIABLE:
+            return variableValue(interpreter, expression);
 
-        optionalInt opInt = { true, v };
-        return opInt;
-    }
-    else {
-        optionalInt opInt = { false, 0 };
-        return opInt;
-    }
-}
-
-// consume past a loop/if statement/function declaration if we want to skip it
-void consumePast(Interpreter* interpreter) {
-    int count = 1;
-    while (count > 0) {
-        if (consume(interpreter, "{")) {
-            count++;
-        }
-        else if (consume(interpreter, "}")) {
-            count--;
-            if (count == 0) {
-                break;
+        case EXPRESSION_CALL: {
+            // the call site remembers the function it reached, so only a different one (or none) is checked again
+            Function* function = interpreter -> functions[expression -> symbol];
+            if (function != expression -> target || function == NULL) {
+                checkCallSite(interpreter, expression, function);
             }
+            return (expression -> position == CALL_TAIL) ? tailCall(interpreter, expression, function) : functionCall(interpreter, expression, function);
         }
-        else {
-            interpreter -> current++;
-        }
-    }
-}
 
-// The plan is to honor as many C operators as possible with
-// the same precedence and associativity
-// e<n> implements operators with precedence 'n' (smaller is higher)
+        case EXPRESSION_SHARE:
+            return interpreter -> locals[expression -> slot] = evaluate(interpreter, expression -> left);
 
-uint64_t expression(Interpreter* interpreter, bool effects, bool insideFunction);
+        case EXPRESSION_NOT:
+            return (evaluate(interpreter, expression -> left) == 0) ? 1 : 0;
 
-uint64_t functionCall(Interpreter* interpreter, bool effects, Function* function);
+        case EXPRESSION_TRUTH:
+            return (evaluate(interpreter, expression -> left) != 0) ? 1 : 0;
+    }
 
-// () [] . -> ...
-uint64_t e1(Interpreter* interpreter, bool effects, bool insideFunction) {
-    optionalSlice id = consumeIdentifier(interpreter);
-    if (id.exists) {
-        uint64_t v;
-        if (consume(interpreter, "(")) {
-            // check if there exists a function call
-            Function* function = functionMapGet(interpreter -> functionNameMap, id.item);
-            if (function != NULL) {
-                v = functionCall(interpreter, effects, function);
-            }
-            else {
-                fail(interpreter);
-            }
-        }
-        else if (insideFunction && mapContains(interpreter -> currentSymbolTable, id.item)) {
-            // utilize the local variable first
-            v = mapGet(interpreter -> currentSymbolTable, id.item);
+    // binary operators: short-circuiting is not implemented, both sides are always evaluated
+    uint64_t v = evaluate(interpreter, expression -> left);
+    if (expression -> kind == EXPRESSION_AND || expression -> kind == EXPRESSION_OR) {
+        // unless nothing could tell that the right side was left out
+        bool decided = (expression -> kind == EXPRESSION_AND) ? (v == 0) : (v != 0);
+        if (decided && rightSkippable(interpreter, expression)) {
+            return (v != 0) ? 1 : 0;
         }
-        else {
-            // if no local variable, use global variable
-            v = mapGet(interpreter -> symbolTable, id.item);
-        }
-        return v;
-    }
-        
-    optionalInt val = consumeLiteral(interpreter);
-    if (val.exists) {
-        return val.item;
     }
+    uint64_t u = evaluate(interpreter, expression -> right);
 
-    if (consume(interpreter, "(")) {
-        uint64_t v = expression(interpreter, effects, insideFunction);
-        consume(interpreter, ")");
-        return v;
+    switch (expression -> kind) {
+        case EXPRESSION_MULTIPLY: return v * u;
+        case EXPRESSION_DIVIDE: return (u == 0) ? 0 : v / u;
+        case EXPRESSION_MODULO: return (u == 0) ? 0 : v % u;
+        case EXPRESSION_ADD: return v + u;
+        case EXPRESSION_SUBTRACT: return v - u;
+        case EXPRESSION_LESS: return (v < u) ? 1 : 0;
+        case EXPRESSION_LESS_EQUAL: return (v <= u) ? 1 : 0;
+        case EXPRESSION_GREATER: return (v > u) ? 1 : 0;
+        case EXPRESSION_GREATER_EQUAL: return (v >= u) ? 1 : 0;
+        case EXPRESSION_EQUAL: return (v == u) ? 1 : 0;
+        case EXPRESSION_NOT_EQUAL: return (v != u) ? 1 : 0;
+        case EXPRESSION_AND: return (v && u) ? 1 : 0;
+        case EXPRESSION_OR: return (v || u) ? 1 : 0;
     }
 
-    fail(interpreter);
+    failAt(&(interpreter -> parser), expression -> offset);
     return 0;
 }
 
-// ++ -- unary+ unary- ... (Right)
-uint64_t e2(Interpreter* interpreter, bool effects, bool insideFunction) {
-    bool neg = false;
-    bool encounteredNeg = false;
+void assign(Interpreter* interpreter, Statement* statement, uint64_t v) {
+    uint32_t slot = statement -> slot;
 
-    // logical not
-    while (true) {
-        if (consume(interpreter, "!")) {
-            encounteredNeg = true;
-            neg = !neg;
-        }
-        else {
-            uint64_t v = e1(interpreter, effects, insideFunction);
-            if (neg) {
-                v = v > 0 ? 0 : 1;
-            }
-            if (encounteredNeg && v > 1) {
-                v = 1;
-            }
-            return v;
-        }
+    /*
+        When an assignment statement is reached in a function:
+            If the LHS is a local variable
+                Reassign local variable
+            Else If the LHS is a global variable
+                Reassign global variable
+            Else
+                Make new local variable
+    */
+    if (statement -> scope == SCOPE_PARAMETER) {
+        interpreter -> locals[slot] = v;
     }
-}
-
-// * / % (Left)
-uint64_t e3(Interpreter* interpreter, bool effects, bool insideFunction) {
-    uint64_t v = e2(interpreter, effects, insideFunction);
-
-    while (true) {
-        if (consume(interpreter, "*")) {
-            v = v * e2(interpreter, effects, insideFunction);
-        }
-        else if (consume(interpreter, "/")) {
-            uint64_t right = e2(interpreter, effects, insideFunction);
-            v = (right == 0) ? 0 : v / right;
-        }
-        else if (consume(interpreter, "%")) {
-            uint64_t right = e2(interpreter, effects, insideFunction);
-            v = (right == 0) ? 0 : v % right;
-        }
-        else {
-            return v;
-        }
+    else if (statement -> scope == SCOPE_LOCAL &&
+            (interpreter -> localDefined[slot] || !interpreter -> globalDefined[statement -> symbol])) {
+        interpreter -> locals[slot] = v;
+        interpreter -> localDefined[slot] = true;
+    }
+    else {
+        interpreter -> globals[statement -> symbol] = v;
+        interpreter -> globalDefined[statement -> symbol] = true;
     }
 }
 
-// (Left) + -
-uint64_t e4(Interpreter* interpreter, bool effects, bool insideFunction) {
-    uint64_t v = e3(interpreter, effects, insideFunction);
-
-    while (true) {
-        if (consume(interpreter, "+")) {
-            v = v + e3(interpreter, effects, insideFunction);
-        }
-        else if (consume(interpreter, "-")) {
-            v = v - e3(interpreter, effects, insideFunction);
-        }
-        else {
-            return v;
-        }
+// where the variable an assignment reads and writes lives, or NULL if the read and the write go to different places
+uint64_t* assignedVariable(Interpreter* interpreter, Statement* statement) {
+    if (statement -> scope == SCOPE_PARAMETER ||
+            (statement -> scope == SCOPE_LOCAL && interpreter -> localDefined[statement -> slot])) {
+        return interpreter -> locals + statement -> slot;
+    }
+    if (interpreter -> globalDefined[statement -> symbol]) {
+        return interpreter -> globals + statement -> symbol;
     }
+    // the first assignment of the variable
+    return NULL;
 }
 
-// << >>
-uint64_t e5(Interpreter* interpreter, bool effects, bool insideFunction) {
-    return e4(interpreter, effects, insideFunction);
+uint64_t operandValue(Interpreter* interpreter, Expression* expression) {
+    return (expression -> kind == EXPRESSION_LITERAL) ? expression -> value : variableValue(interpreter, expression);
 }
 
-// < <= > >=
-uint64_t e6(Interpreter* interpreter, bool effects, bool insideFunction) {
-    uint64_t v = e5(interpreter, effects, insideFunction);
-
-    while (true) {
-        if (consume(interpreter, "<=")) {
-            uint64_t u = e5(interpreter, effects, insideFunction);
-            v = (v <= u) ? 1 : 0;
-        }
-        else if (consume(interpreter, ">=")) {
-            uint64_t u = e5(interpreter, effects, insideFunction);
-            v = (v >= u) ? 1 : 0;
-        }
-        else if (consume(interpreter, "<")) {
-            uint64_t u = e5(interpreter, effects, insideFunction);
-            v = (v < u) ? 1 : 0;
-        }
-        else if (consume(interpreter, ">")) {
-            uint64_t u = e5(interpreter, effects, insideFunction);
-            v = (v > u) ? 1 : 0;
-        }
-        else {
-            return v;
-        }
+uint64_t compare(uint32_t kind, uint64_t v, uint64_t u) {
+    switch (kind) {
+        case EXPRESSION_LESS: return v < u;
+        case EXPRESSION_LESS_EQUAL: return v <= u;
+        case EXPRESSION_GREATER: return v > u;
+        case EXPRESSION_GREATER_EQUAL: return v >= u;
+        case EXPRESSION_EQUAL: return v == u;
+        default: return v != u;
     }
 }
 
-// == !=
-uint64_t e7(Interpreter* interpreter, bool effects, bool insideFunction) {
-    uint64_t v = e6(interpreter, effects, insideFunction);
-
-    while (true) {
-        if (consume(interpreter, "==")) {
-            uint64_t u = e6(interpreter, effects, insideFunction);
-            v = (v == u) ? 1 : 0;
-        }
-        else if (consume(interpreter, "!=")) {
-            uint64_t u = e6(interpreter, effects, insideFunction);
-            v = (v != u) ? 1 : 0;
-        }
-        else {
-            return v;
-        }
+// the condition of an if / while, compared right away if it is a SHAPE_COMPARE (or SHAPE_COUNTED)
+uint64_t condition(Interpreter* interpreter, Statement* statement) {
+    Expression* e = statement -> expression;
+    if (statement -> shape < SHAPE_COMPARE) {
+        return evaluate(interpreter, e);
     }
+    return compare(e -> kind, operandValue(interpreter, e -> left), operandValue(interpreter, e -> right));
 }
 
-// (left) &
-uint64_t e8(Interpreter* interpreter, bool effects, bool insideFunction) {
-    return e7(interpreter, effects, insideFunction);
-}
-
-// ^
-uint64_t e9(Interpreter* interpreter, bool effects, bool insideFunction) {
-    return e8(interpreter, effects, insideFunction);
+// is the variable in the running frame, where no call can change it
+bool inFrame(Interpreter* interpreter, Expression* variable) {
+    return variable -> kind == EXPRESSION_LITERAL || variable -> scope == SCOPE_PARAMETER ||
+        (variable -> scope == SCOPE_LOCAL && interpreter -> localDefined[variable -> slot]);
 }
 
-// |
-uint64_t e10(Interpreter* interpreter, bool effects, bool insideFunction) {
-    return e9(interpreter, effects, insideFunction);
-}
-
-// &&
-uint64_t e11(Interpreter* interpreter, bool effects, bool insideFunction) {
-    uint64_t v = e10(interpreter, effects, insideFunction);
+void executeBlock(Interpreter* interpreter, Block* block);
 
-    while (true) {
-        if (consume(interpreter, "&&")) {
-            v = e10(interpreter, effects, insideFunction) && v;
-        }
-        else {
-            return v;
-        }
+// while (i < n) { ...; i = i + k } (SHAPE_COUNTED): i is kept in a C variable, and n is read once.
+// Returns false without running anything if a call in the body could change either, or i is not assigned yet
+// (or the profiler has to see the increment run)
+bool countedLoop(Interpreter* interpreter, Statement* statement) {
+    Expression* e = statement -> expression;
+    Statement* increment = statement -> body.statements[statement -> body.length - 1];
+    if (interpreter -> profiler.enabled) {
+        return false;
+    }
+    if (statement -> loopCalls && !(inFrame(interpreter, e -> left) && inFrame(interpreter, e -> right))) {
+        return false;
+    }
+    if (assignedVariable(interpreter, increment) == NULL) {
+        return false;
     }
-}
 
-// ||
-uint64_t e12(Interpreter* interpreter, bool effects, bool insideFunction) {
-    uint64_t v = e11(interpreter, effects, insideFunction);
-    
-    while (true) {
-        if (consume(interpreter, "||")) {
-            v = e11(interpreter, effects, insideFunction) || v;
-        }
-        else {
-            return v;
+    uint64_t i = variableValue(interpreter, e -> left);
+    uint64_t n = operandValue(interpreter, e -> right);
+    Block body = statement -> body;
+    body.length--;
+    while (compare(e -> kind, i, n) != 0) {
+        executeBlock(interpreter, &body);
+        if (interpreter -> functionReturn.exists) {
+            return true;
         }
+        // (a call may have moved the frame or the globals)
+        i += increment -> step;
+        *assignedVariable(interpreter, increment) = i;
+        STAT_ADD(statements, 1);
     }
+    return true;
 }
 
-// (right with special treatment for middle expression) ?:
-uint64_t e13(Interpreter* interpreter, bool effects, bool insideFunction) {
-    return e12(interpreter, effects, insideFunction);
-}
-
-// = += -= ...
-uint64_t e14(Interpreter* interpreter, bool effects, bool insideFunction) {
-    return e13(interpreter, effects, insideFunction);
-}
+void executeStatement(Interpreter* interpreter, Statement* statement);
 
-// ,
-uint64_t e15(Interpreter* interpreter, bool effects, bool insideFunction) {
-    return e14(interpreter, effects, insideFunction);
-}
-
-uint64_t expression(Interpreter* interpreter, bool effects, bool insideFunction) {
-    return e15(interpreter, effects, insideFunction);
-}
-
-bool statement(Interpreter* interpreter, bool effects, bool insideFunction);
-
-// checks if a return statement is/was reached
-bool checkReturn(Interpreter* interpreter, bool effects, bool insideFunction) {
-    if (insideFunction && interpreter -> functionReturn.exists) {
-        return true;
-    }
-    char* currentPointer = (interpreter -> current);
-    optionalSlice s = consumeIdentifier(interpreter);
-    if (insideFunction && s.exists && sliceEqualString(s.item, "return")) {
-        // return the corresponding value
-        optionalInt v = { true, expression(interpreter, effects, insideFunction) };
-        interpreter -> functionReturn = v;
-        return true;
+void execute(Interpreter* interpreter, Statement* statement) {
+    STAT_ADD(statements, 1);
+    if (interpreter -> profiler.enabled) {
+        uint64_t line = profileStatementStart(&(interpreter -> profiler), statement);
+        executeStatement(interpreter, statement);
+        profileStatementEnd(&(interpreter -> profiler), line);
+        return;
     }
-
-    // reset the pointer since no return was discovered
-    interpreter -> current = currentPointer;
-    return false;
+    executeStatement(interpreter, statement);
 }
 
-// parse a while loop
-bool whileStatement(Interpreter* interpreter, bool effects, bool insideFunction) {
-    char* currentPointer = (interpreter -> current);
-    while (true) {
-        consumeOrFail(interpreter, "(");
-        uint64_t v = expression(interpreter, effects, insideFunction);
-        consumeOrFail(interpreter, ")");
-
-        if (v == 0) {
-            // skip over while loop
-            consumeOrFail(interpreter, "{");
-            consumePast(interpreter);
-            return false;
-        }
-        else {
-            // enter while loop
-            consumeOrFail(interpreter, "{");
-            while (!consume(interpreter, "}")) {
-                if (checkReturn(interpreter, effects, insideFunction)) {
-                    consumePast(interpreter);
-                    return true;
-                }
-
-                if (!statement(interpreter, effects, insideFunction)) {
-                    fail(interpreter);
+void executeStatement(Interpreter* interpreter, Statement* statement) {
+    switch (statement -> kind) {
+        case STATEMENT_ASSIGN: {
+            // x = x + ...: one lookup, when the variable is read and written in the same place
+            if (statement -> shape != SHAPE_GENERIC) {
+                uint64_t* variable = assignedVariable(interpreter, statement);
+                if (variable != NULL) {
+                    *variable += (statement -> shape == SHAPE_INCREMENT) ? statement -> step : evaluate(interpreter, statement -> operand);
+                    return;
                 }
             }
-
-            // reset the pointer to check the conditional again
-            interpreter -> current = currentPointer;
+            assign(interpreter, statement, evaluate(interpreter, statement -> expression));
+            return;
         }
-    }
 
-    return false;
-}
+        case STATEMENT_CALL:
+            evaluate(interpreter, statement -> expression);
+            return;
 
-// performs the body of a function
-uint64_t performFunction(Interpreter* interpreter, bool effects, Function* function) {    
-    char* currentPointer = interpreter -> current;
+        case STATEMENT_IF:
+            if (condition(interpreter, statement) != 0) {
+                executeBlock(interpreter, &(statement -> body));
+            }
+            else {
+                executeBlock(interpreter, &(statement -> elseBody));
+            }
+            return;
 
-    // move pointer to where the function was defined in order to do the function operations
-    interpreter -> current = function -> pointer;
+        case STATEMENT_WHILE:
+            if (statement -> shape == SHAPE_COUNTED && countedLoop(interpreter, statement)) {
+                return;
+            }
+            while (condition(interpreter, statement) != 0) {
+                executeBlock(interpreter, &(statement -> body));
+                if (interpreter -> functionReturn.exists) {
+                    return;
+                }
+            }
+            return;
 
-    uint64_t v = 0; 
+        case STATEMENT_RETURN: {
+            optionalInt v = { true, evaluate(interpreter, statement -> expression) };
+            interpreter -> functionReturn = v;
+            return;
+        }
 
-    consumeOrFail(interpreter, "{");
+        case STATEMENT_FUN:
+            // make this the function its name refers to from now on
+            memoInvalidate(&(interpreter -> memo), interpreter -> functions[statement -> function -> symbol] != NULL);
+            interpreter -> functions[statement -> function -> symbol] = statement -> function;
+            return;
+    }
+}
 
-    while (!consume(interpreter, "}")) {
-        if (interpreter -> functionReturn.exists || checkReturn(interpreter, effects, true)) {
-            // if a return was reached, set the return value and reset functionReturn in interpreter
-            v = interpreter -> functionReturn.item;
-            optionalInt val = { false, 0 };
-            interpreter -> functionReturn = val;
-            break;
-        }
-        if (!statement(interpreter, effects, true)) {
-            fail(interpreter);
+// runs the statements of a block until the end or until a return is reached
+void executeBlock(Interpreter* interpreter, Block* block) {
+    for (uint64_t i = 0; i < block -> length; i++) {
+        execute(interpreter, block -> statements[i]);
+        if (interpreter -> functionReturn.exists) {
+            return;
         }
     }
+}
+
+// performs the body of a function
+uint64_t performFunction(Interpreter* interpreter, Function* function) {
+    executeBlock(interpreter, &(function -> body));
 
+    // if a return was reached, take its value and reset functionReturn in interpreter
+    uint64_t v = 0;
     if (interpreter -> functionReturn.exists) {
         v = interpreter -> functionReturn.item;
         optionalInt val = { false, 0 };
         interpreter -> functionReturn = val;
     }
-
-    // set pointer back
-    interpreter -> current = currentPointer;
-
     return v;
 }
 
-uint64_t functionCall(Interpreter* interpreter, bool effects, Function* function) {    
-    // create a new local map for the current state
-    UnorderedMap* previousSymbolTable = interpreter -> currentSymbolTable;
-    UnorderedMap* currentSymbolTable = mapCreate();
+// makes sure the stack has room for the given number of slots, which may move it
+void reserveStack(Interpreter* interpreter, uint64_t needed) {
+    if (needed <= interpreter -> stackCapacity) {
+        return;
+    }
 
-    consume(interpreter, "(");
-    uint64_t parameterCount = 0;
+    uint64_t capacity = (interpreter -> stackCapacity == 0) ? 1024 : interpreter -> stackCapacity;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    interpreter -> stack = (uint64_t*) (realloc(interpreter -> stack, sizeof(uint64_t) * capacity));
+    interpreter -> stackDefined = (bool*) (realloc(interpreter -> stackDefined, sizeof(bool) * capacity));
+    interpreter -> stackCapacity = capacity;
 
-    // read in all parameters 
-    while (!consume(interpreter, ")")) {
-        uint64_t value = expression(interpreter, effects, true);
-        // printSlice(function -> parameters[parameterCount]);
-        // printf(" %ld \n", value);
+    interpreter -> locals = interpreter -> stack + interpreter -> frameBase;
+    interpreter -> localDefined = interpreter -> stackDefined + interpreter -> frameBase;
+}
 
-        mapInsert(currentSymbolTable, function -> parameters[parameterCount], value);
-        parameterCount++;
-        consume(interpreter, ",");
-    }
-    
-    if (parameterCount != function -> numParams) {
-        fail(interpreter);
-    }
+// makes the frame starting at the given slot the running one
+void enterFrame(Interpreter* interpreter, uint64_t base) {
+    interpreter -> frameBase = base;
+    interpreter -> locals = interpreter -> stack + base;
+    interpreter -> localDefined = interpreter -> stackDefined + base;
+}
 
-    interpreter -> currentSymbolTable = currentSymbolTable;
+void growGlobals(Interpreter* interpreter);
 
-    // special function print -> need to actually print the value returned
-    if (sliceEqualString(function -> name, "print")) {
-        uint64_t v = mapGet(interpreter -> currentSymbolTable, function -> parameters[0]);
-        if (effects) {
-            printf("%lu\n", v);
-        }
-        interpreter -> currentSymbolTable = previousSymbolTable;
-        freeMap(currentSymbolTable);
-        // print function default return is 0
-        return 0;
+// parses, resolves and optimizes the body of a function the first time it is called
+void prepareFunction(Interpreter* interpreter, Function* function) {
+    if (function -> parsed) {
+        return;
     }
+    functionBody(&(interpreter -> parser), function);
+    resolveFunction(&(interpreter -> resolver), function);
+    optimizeFunction(&(interpreter -> optimizer), function);
+    growGlobals(interpreter);
+    function -> parsed = true;
+    memoInvalidate(&(interpreter -> memo), false);
+}
 
-    uint64_t v = performFunction(interpreter, effects, function);
-
-    // reset the currentSymbolTable to waht it was before the function call
-    interpreter -> currentSymbolTable = previousSymbolTable;
-    freeMap(currentSymbolTable);
-    return v;
+// a call reached a function it has not called before: fails if there is none, prepares it,
+// and remembers it in the call site if the arguments match its parameters (a mismatch
+// fails in pushArguments, once the arguments have been evaluated)
+void checkCallSite(Interpreter* interpreter, Expression* call, Function* function) {
+    if (function == NULL) {
+        failAt(&(interpreter -> parser), missingFunctionOffset(&(interpreter -> parser), call));
+    }
+    prepareFunction(interpreter, function);
+    call -> target = (call -> numArguments == function -> numParams) ? function : NULL;
 }
 
-bool statement(Interpreter* interpreter, bool effects, bool insideFunction) {
-    // printf("START\n%s\nEND\n\n", (interpreter -> current));
+// evaluates the arguments of a call into a new frame at the top of the stack
+uint64_t pushArguments(Interpreter* interpreter, Expression* call, Function* function) {
+    // none of the frame's locals exist yet
+    uint64_t base = interpreter -> stackTop;
+    reserveStack(interpreter, base + function -> frameSize);
+    interpreter -> stackTop = base + function -> frameSize;
+    memset(interpreter -> stackDefined + base, 0, function -> frameSize);
 
-    if (consume(interpreter, "#")) {
-        // this line is a comment, skip it
-        while (interpreter -> current[0] != '\n') {
-            interpreter -> current++;
+    // evaluate all arguments in the caller's scope (calls made here push their frames above this one)
+    for (uint64_t i = 0; i < call -> numArguments; i++) {
+        uint64_t value = evaluate(interpreter, call -> arguments[i]);
+        if (i < function -> numParams) {
+            interpreter -> stack[base + i] = value;
         }
-        return true;
     }
 
-    if (checkReturn(interpreter, effects, insideFunction)) {
-        return true;
+    if (call -> target != function) {
+        failAt(&(interpreter -> parser), call -> end);
+    }
+    return base;
+}
+
+uint64_t functionCall(Interpreter* interpreter, Expression* call, Function* function) {
+    // fail cleanly on runaway recursion instead of running out of stack
+    char marker;
+    if (interpreter -> depth == interpreter -> maxDepth || (uintptr_t) &marker < interpreter -> cStackLimit) {
+        failAt(&(interpreter -> parser), call -> end);
     }
 
-    optionalSlice id = consumeIdentifier(interpreter);
+    // push a new frame for the current state
+    uint64_t previousBase = interpreter -> frameBase;
+    uint64_t base = pushArguments(interpreter, call, function);
+    STAT_ADD(calls, 1);
+    bool profiling = interpreter -> profiler.enabled;
+    if (profiling) {
+        profileEnter(&(interpreter -> profiler), function -> symbol);
+    }
 
-    if (!id.exists) {
-        return false;
+    // a pure function called with these arguments before gives the same value again
+    Function* called = function;
+    uint64_t arguments[MEMO_MAX_ARGUMENTS];
+    bool memoize = memoUsable(&(interpreter -> memo), function, interpreter -> functions, interpreter -> globalDefined);
+    if (memoize) {
+        memcpy(arguments, interpreter -> stack + base, sizeof(uint64_t) * function -> numParams);
     }
 
-    if (sliceEqualString(id.item, "if")) {
-        // if ... 
-        consumeOrFail(interpreter, "(");
-        uint64_t v = expression(interpreter, effects, insideFunction);
-        consumeOrFail(interpreter, ")");
-
-        if (v == 0) {
-            // skip over if statement
-            consumeOrFail(interpreter, "{");
-            consumePast(interpreter);
-
-            // check if there is an else statement. If there is, enter the statement. If not, move pointer back and continue
-            char* prevPointer = interpreter -> current;
-            optionalSlice checkElse = consumeIdentifier(interpreter);            
-            if (sliceEqualString(checkElse.item, "else")) {
-                consumeOrFail(interpreter, "{");
-
-                while (!consume(interpreter, "}")) {
-                    if (checkReturn(interpreter, effects, insideFunction)) {
-                        consumePast(interpreter);
-                        return true;
-                    }
-                    if (!statement(interpreter, effects, insideFunction)) {
-                        fail(interpreter);
-                    }
-                }
+    uint64_t v = 0;
+    if (function -> native != NULL) {
+        v = function -> native(interpreter, interpreter -> stack + base);
+    }
+    else if (memoize && memoFind(&(interpreter -> memo), function, arguments, &v)) {
+        // cached
+    }
+    else {
+        interpreter -> depth++;
+        STAT_MAX(maxDepth, interpreter -> depth);
+        while (true) {
+            // machine code would not consult the cache for the calls it makes
+            if (function -> jitEntry == NULL && !memoize) {
+                jitCount(&(interpreter -> jit), function);
+            }
+            if (function -> jitEntry != NULL) {
+                v = ((JitEntry) function -> jitEntry)(interpreter -> stack + base, interpreter -> globals,
+                    interpreter -> globalDefined, interpreter -> maxDepth - interpreter -> depth);
             }
             else {
-                interpreter -> current = prevPointer;
+                enterFrame(interpreter, base);
+                v = performFunction(interpreter, function);
             }
-        }
-        else {
-            // enter if statement
-            consumeOrFail(interpreter, "{");
-            while (!consume(interpreter, "}")) {
-                if (checkReturn(interpreter, effects, insideFunction)) {
-                    consumePast(interpreter);
-                    return true;
-                }
-                if (!statement(interpreter, effects, insideFunction)) {
-                    fail(interpreter);
-                }
+            if (interpreter -> tailFunction == NULL) {
+                break;
             }
 
-            // check for else statement
-            char* prevPointer = interpreter -> current;
-            optionalSlice checkElse = consumeIdentifier(interpreter);
-            if (sliceEqualString(checkElse.item, "else")) {
-                consumeOrFail(interpreter, "{");
-                // skip the else
-                consumePast(interpreter);
-            }
-            else {
-                interpreter -> current = prevPointer;
+            // the body ended with a tail call: its frame replaces this one, and the loop runs it
+            function = interpreter -> tailFunction;
+            interpreter -> tailFunction = NULL;
+            STAT_ADD(calls, 1);
+            if (profiling) {
+                profileLeave(&(interpreter -> profiler));
+                profileEnter(&(interpreter -> profiler), function -> symbol);
             }
+            memmove(interpreter -> stack + base, interpreter -> stack + interpreter -> tailBase, sizeof(uint64_t) * function -> numParams);
+            memset(interpreter -> stackDefined + base, 0, function -> frameSize);
+            interpreter -> stackTop = base + function -> frameSize;
+        }
+        interpreter -> depth--;
+        if (memoize) {
+            memoStore(&(interpreter -> memo), called, arguments, v);
         }
-
-        return true;
-    }
-
-    if (sliceEqualString(id.item, "while")) {
-        // while ... 
-        whileStatement(interpreter, effects, insideFunction);
-        return true;
     }
 
-    if (sliceEqualString(id.item, "else")) {
-        // error, cannot have else without a preceding if statement
-        fail(interpreter);
+    if (profiling) {
+        profileLeave(&(interpreter -> profiler));
     }
 
-    if (sliceEqualString(id.item, "fun")) {
-        if (insideFunction) {
-            // cannot define a function inside another function
-            fail(interpreter);
-        }
-
-        // fun ... 
-        optionalSlice functionName = consumeIdentifier(interpreter);
-        Function* currentFunction = (Function*) (malloc(sizeof(Function)));
-        currentFunction -> numParams = 0;
-
-        if (functionName.exists) {
-            currentFunction -> name = functionName.item;
-        }
-        else {
-            fail(interpreter);
-        }
-
-        consume(interpreter, "(");
-        char* beforePointer = interpreter -> current;
-
-        // find the number of parameters in this function to malloc the parameter array
-        while (!consume(interpreter, ")")) {
-            optionalSlice parameterName = consumeIdentifier(interpreter);
-            if (parameterName.exists) {
-                currentFunction -> numParams++;
-            }
-            else {
-                fail(interpreter);
-            }
-            consume(interpreter, ",");
-        }
-
-        currentFunction -> parameters = (Slice*) (malloc(sizeof(Slice) * currentFunction -> numParams));
-
-        interpreter -> current = beforePointer;
-        uint64_t i = 0;
-
-        // consume parameters 
-        while (!consume(interpreter, ")")) {
-            optionalSlice parameterName = consumeIdentifier(interpreter);
-            currentFunction -> parameters[i++] = parameterName.item;
-            consume(interpreter, ",");
-        }
-
-        currentFunction -> pointer = interpreter -> current;
+    // pop the frame and go back to the caller's
+    enterFrame(interpreter, previousBase);
+    interpreter -> stackTop = base;
+    return v;
+}
 
-        // enter this function into the function map which maps the function name to the function struct
-        functionMapInsert(interpreter -> functionNameMap, functionName.item, currentFunction);
+// return f(...): evaluates the arguments, then leaves the call to the caller's functionCall,
+// so tail recursion runs in constant space
+uint64_t tailCall(Interpreter* interpreter, Expression* call, Function* function) {
+    if (function -> native != NULL) {
+        return functionCall(interpreter, call, function);
+    }
+    // the call replaces the running one, so it cannot get any deeper
+    interpreter -> tailBase = pushArguments(interpreter, call, function);
+    interpreter -> tailFunction = function;
+    return 0;
+}
 
-        // skip past the function for now, only need to read in body of function when we call the function
-        consumeOrFail(interpreter, "{");
-        consumePast(interpreter);
+// makes room for the global and the function of every name the resolver has seen so far
+void growGlobals(Interpreter* interpreter) {
+    uint64_t needed = interpreter -> resolver.numGlobals;
+    if (needed <= interpreter -> globalCapacity) {
+        return;
+    }
 
-        return true;
+    uint64_t capacity = (interpreter -> globalCapacity == 0) ? 64 : interpreter -> globalCapacity;
+    while (capacity < needed) {
+        capacity *= 2;
     }
-    
-    // check for invalid variable names
-    if (sliceEqualString(id.item, "if") || sliceEqualString(id.item, "else") || sliceEqualString(id.item, "while") || 
-            sliceEqualString(id.item, "return") || sliceEqualString(id.item, "fun")) {
-        fail(interpreter);
+    interpreter -> globals = (uint64_t*) (realloc(interpreter -> globals, sizeof(uint64_t) * capacity));
+    interpreter -> globalDefined = (bool*) (realloc(interpreter -> globalDefined, sizeof(bool) * capacity));
+    interpreter -> functions = (Function**) (realloc(interpreter -> functions, sizeof(Function*) * capacity));
+    for (uint64_t i = interpreter -> globalCapacity; i < capacity; i++) {
+        interpreter -> globals[i] = 0;
+        interpreter -> globalDefined[i] = false;
+        interpreter -> functions[i] = NULL;
     }
+    interpreter -> globalCapacity = capacity;
+}
 
-    if (consume(interpreter, "=")) {
-        uint64_t v = expression(interpreter, effects, insideFunction);
-
-        if (effects) {
-            if (!insideFunction) {
-                mapInsert(interpreter -> symbolTable, id.item, v);
-            }
-            else {
-                /*
-                    When an assignment statement is reached in a function:
-                        If the LHS is a local variable
-                            Reassign local variable
-                        Else If the LHS is a global variable
-                            Reassign global variable
-                        Else
-                            Make new local variable
-                */
-                if (mapContains(interpreter -> currentSymbolTable, id.item)) {
-                    // update the local variable
-                    mapInsert(interpreter -> currentSymbolTable, id.item, v);
-                }
-                else if (mapContains(interpreter -> symbolTable, id.item)) {
-                    // update the global variable
-                    mapInsert(interpreter -> symbolTable, id.item, v);
-                }
-                else {
-                    // create a new local variable
-                    mapInsert(interpreter -> currentSymbolTable, id.item, v);
-                }
-            }
-        }
+// parses, resolves and optimizes the next top-level statement, or returns NULL at the end of the program.
+// The previous statement has run by now, so its tree goes (the functions it declared stay)
+Statement* nextStatement(Interpreter* interpreter) {
+    Parser* parser = &(interpreter -> parser);
+    arenaReset(&(interpreter -> statementArena));
+    Statement* s = (parser -> input == NULL) ? statement(parser, false) : streamStatement(parser);
+    if (s == NULL) {
+        endOrFail(&(interpreter -> parser));
+        return NULL;
+    }
+    resolveStatement(&(interpreter -> resolver), s);
+    Optimizer* optimizer = &(interpreter -> optimizer);
+    optimizer -> arena = &(interpreter -> statementArena);
+    optimizeTopLevel(optimizer, s);
+    optimizer -> arena = &(interpreter -> arena);
+    growGlobals(interpreter);
+    return s;
+}
 
-        return true;
+// sets the lowest address the C stack may reach, measured from the caller's frame
+void limitCStack(Interpreter* interpreter) {
+    char marker;
+    struct rlimit limit;
+    uint64_t size = interpreter -> cStackSize;
+    if (size == 0 && getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        size = limit.rlim_cur;
+    }
+    if (size <= 2 * C_STACK_MARGIN) {
+        interpreter -> cStackLimit = 0;
     }
     else {
-        // can have a stand-alone function call without doing (var) = (function call)
-        Function* function = functionMapGet(interpreter -> functionNameMap, id.item);
-        if (function != NULL) {
-            functionCall(interpreter, effects, function);
-        }
-        else {
-            fail(interpreter);
-        }
-
-        return true;
+        interpreter -> cStackLimit = (uintptr_t) &marker - (size - C_STACK_MARGIN);
     }
-
-    return false;
+    interpreter -> jit.stackLimit = interpreter -> cStackLimit;
 }
 
-void statements(Interpreter* interpreter, bool effects) {
-    while (statement(interpreter, effects, false));
+// parses and runs one top-level statement at a time, so a function is defined once its declaration has run
+void run(Interpreter* interpreter) {
+    limitCStack(interpreter);
+    Statement* s;
+    while ((s = nextStatement(interpreter)) != NULL) {
+        execute(interpreter, s);
+    }
 }
 
-void run(Interpreter* interpreter) {
-    statements(interpreter, true);
-    endOrFail(interpreter);
+// where machine code fails: the same message as the engines
+void jitFailAt(void* context, uint64_t offset) {
+    Interpreter* interpreter = (Interpreter*) context;
+    failAt(&(interpreter -> parser), offset);
 }
 
-Function* createPrintFunction() {
-    Function* currentFunction = (Function*) (malloc(sizeof(Function)));
-    currentFunction -> name = sliceConstructorLen("print", 5);
-    currentFunction -> numParams = 1;
-    currentFunction -> parameters = (Slice*) (malloc(sizeof(Slice)));
-    currentFunction -> parameters[0] = sliceConstructorLen(".", 1);
-    return currentFunction;
+// print(value): writes the value on a line of its own, returns 0
+uint64_t nativePrint(Interpreter* interpreter, uint64_t* arguments) {
+    outputLine(&(interpreter -> output), arguments[0]);
+    return 0;
 }
 
-Interpreter* interpreterConstructor(char* prog) {
-    Interpreter* interpreter = (Interpreter*) (malloc(sizeof(Interpreter)));
-    interpreter -> program = prog;
-    interpreter -> current = prog;
+// declares a builtin implemented by the given C function
+void defineNative(Interpreter* interpreter, char const* name, uint64_t numParams,
+        uint64_t (*native)(Interpreter* interpreter, uint64_t* arguments)) {
+    Arena* arena = &(interpreter -> arena);
+    Function* function = (Function*) (arenaCalloc(arena, sizeof(Function)));
+    function -> name = sliceConstructorLen(name, strlen(name));
+    function -> symbol = lexerIntern(&(interpreter -> parser.lexer), function -> name);
+    function -> numParams = numParams;
+    // the parameters are never looked up by name
+    function -> parameters = (uint64_t*) (arenaCalloc(arena, sizeof(uint64_t) * numParams));
+    function -> frameSize = numParams;
+    function -> parsed = true;
+    function -> compiled = true;
+    function -> native = native;
+
+    noteSymbol(&(interpreter -> resolver), function -> symbol);
+    growGlobals(interpreter);
+    interpreter -> functions[function -> symbol] = function;
+}
+
+// cacheDirectory: where to keep the program's tokens between runs (--cache), or NULL, and source: what the
+// program was read from, which is how the cache finds them
+Interpreter* interpreterConstructor(char* prog, char const* cacheDirectory, struct stat const* source) {
+    Interpreter* interpreter = (Interpreter*) (calloc(1, sizeof(Interpreter)));
+    arenaConstructor(&(interpreter -> arena));
+    arenaConstructor(&(interpreter -> statementArena));
+    outputConstructor(&(interpreter -> output), STDOUT_FILENO);
+    parserConstructor(&(interpreter -> parser), prog, &(interpreter -> arena), &(interpreter -> statementArena),
+        &(interpreter -> output), cacheDirectory, source);
+    resolverConstructor(&(interpreter -> resolver));
+    optimizerConstructor(&(interpreter -> optimizer), &(interpreter -> arena));
     optionalInt v = { false, 0 };
     interpreter -> functionReturn = v;
-    interpreter -> currentSymbolTable = mapCreate();
-    interpreter -> symbolTable = mapCreate();
-    interpreter -> functionNameMap = functionMapCreate();
-    
-    // create a default print function
-    functionMapInsert(interpreter -> functionNameMap, sliceConstructorLen("print", 5), createPrintFunction());
+    interpreter -> maxDepth = DEFAULT_MAX_DEPTH;
+    reserveStack(interpreter, 1024);
+    jitConstructor(&(interpreter -> jit), jitFailAt, interpreter);
+    memoConstructor(&(interpreter -> memo), &(interpreter -> arena));
+    profilerConstructor(&(interpreter -> profiler), prog);
+
+    defineNative(interpreter, "print", 1, nativePrint);
 
     return interpreter;
 }
+
+// free's everything the interpreter allocated: the runtime arrays, then the arena with everything else
+void freeInterpreter(Interpreter* interpreter) {
+    free(interpreter -> globals);
+    free(interpreter -> globalDefined);
+    free(interpreter -> functions);
+    free(interpreter -> stack);
+    free(interpreter -> stackDefined);
+    freeLexer(&(interpreter -> parser.lexer));
+    freeResolver(&(interpreter -> resolver));
+    freeOptimizer(&(interpreter -> optimizer));
+    freeOutput(&(interpreter -> output));
+    freeJit(&(interpreter -> jit));
+    freeMemo(&(interpreter -> memo));
+    freeProfiler(&(interpreter -> profiler));
+    freeArena(&(interpreter -> statementArena));
+    freeArena(&(interpreter -> arena));
+    free(interpreter);
+}
@@ -0,0 +1,657 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Implementation includes
+#include "astc.h"
+
+// An in-process JIT for hot functions. The engines count the calls to every
+// function, and once a function has been called JIT_THRESHOLD times its body is
+// translated into x86-64 machine code in an mmap'd region, and every later call
+// runs that code instead.
+//
+// Only functions whose calls all go to the function itself are translated
+// (recursive kernels like fib or ackermann). Everything else keeps running in
+// the engine that called it. While a function runs, it is the function its name
+// refers to (declarations only run at the top level), so a call to its own name
+// can jump straight to its own code.
+//
+// The code uses the same frame layout as the -S compiler, with the context in
+// callee-saved registers:
+//
+//      rbx   the global array              r12   the global defined flags
+//      r13   how many more calls may be active before --max-depth is reached
+//
+// and fails through the fail callback (which does not return) exactly where
+// the tree walker would.
+
+#define JIT_THRESHOLD 100
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+// called with the arguments, the global array, the defined flags and how many more calls may be active
+typedef uint64_t (*JitEntry)(uint64_t* arguments, uint64_t* globals, bool* globalDefined, uint64_t depthBudget);
+
+// fails at the given program offset, never returns
+typedef void (*JitFail)(void* context, uint64_t offset);
+
+typedef struct Jit {
+    // every region of machine code, unmapped when the jit is freed
+    void** regions;
+    uint64_t* regionSizes;
+    uint64_t numRegions;
+    uint64_t regionCapacity;
+
+    bool enabled;                       // --no-jit turns translation off
+    uintptr_t stackLimit;               // the code fails before the C stack gets lower than this
+    JitFail fail;
+    void* failContext;
+} Jit;
+
+typedef struct JitAssembler {
+    uint8_t* code;
+    uint64_t length;
+    uint64_t capacity;
+
+    // where every label was bound
+    uint64_t* labels;
+    uint64_t numLabels;
+    uint64_t labelCapacity;
+
+    // rel32 operands to fill in once every label is bound
+    uint64_t* fixupPositions;
+    uint64_t* fixupLabels;
+    uint64_t numFixups;
+    uint64_t fixupCapacity;
+
+    // a fail stub for every place that can fail, emitted after the body
+    uint64_t* failLabels;
+    uint64_t* failOffsets;
+    uint64_t numFails;
+    uint64_t failCapacity;
+
+    Jit* jit;
+    Function* function;
+    uint64_t returnLabel;
+    uint64_t entryLabel;
+    uint64_t bodyLabel;                 // where a tail call starts the function over
+} JitAssembler;
+
+void jitByte(JitAssembler* a, uint8_t byte) {
+    if (a -> length == a -> capacity) {
+        a -> capacity = (a -> capacity == 0) ? 4096 : a -> capacity * 2;
+        a -> code = (uint8_t*) (realloc(a -> code, a -> capacity));
+    }
+    a -> code[a -> length++] = byte;
+}
+
+void jitBytes(JitAssembler* a, char const* bytes, uint64_t length) {
+    for (uint64_t i = 0; i < length; i++) {
+        jitByte(a, (uint8_t) bytes[i]);
+    }
+}
+
+void jitU32(JitAssembler* a, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        jitByte(a, (uint8_t) (value >> (8 * i)));
+    }
+}
+
+void jitU64(JitAssembler* a, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        jitByte(a, (uint8_t) (value >> (8 * i)));
+    }
+}
+
+uint64_t jitNewLabel(JitAssembler* a) {
+    if (a -> numLabels == a -> labelCapacity) {
+        a -> labelCapacity = (a -> labelCapacity == 0) ? 64 : a -> labelCapacity * 2;
+        a -> labels = (uint64_t*) (realloc(a -> labels, sizeof(uint64_t) * a -> labelCapacity));
+    }
+    a -> labels[a -> numLabels] = UINT64_MAX;
+    return a -> numLabels++;
+}
+
+void jitBind(JitAssembler* a, uint64_t label) {
+    a -> labels[label] = a -> length;
+}
+
+// a rel32 operand pointing at the label
+void jitRel32(JitAssembler* a, uint64_t label) {
+    if (a -> numFixups == a -> fixupCapacity) {
+        a -> fixupCapacity = (a -> fixupCapacity == 0) ? 64 : a -> fixupCapacity * 2;
+        a -> fixupPositions = (uint64_t*) (realloc(a -> fixupPositions, sizeof(uint64_t) * a -> fixupCapacity));
+        a -> fixupLabels = (uint64_t*) (realloc(a -> fixupLabels, sizeof(uint64_t) * a -> fixupCapacity));
+    }
+    a -> fixupPositions[a -> numFixups] = a -> length;
+    a -> fixupLabels[a -> numFixups++] = label;
+    jitU32(a, 0);
+}
+
+// jmp label
+void jitJump(JitAssembler* a, uint64_t label) {
+    jitByte(a, 0xE9);
+    jitRel32(a, label);
+}
+
+// j<condition> label, condition is the low nibble of the 0F 8x opcode
+#define JIT_BELOW 0x2
+#define JIT_ABOVE_EQUAL 0x3
+#define JIT_EQUAL 0x4
+#define JIT_NOT_EQUAL 0x5
+#define JIT_BELOW_EQUAL 0x6
+#define JIT_ABOVE 0x7
+
+void jitJumpIf(JitAssembler* a, uint8_t condition, uint64_t label) {
+    jitByte(a, 0x0F);
+    jitByte(a, 0x80 | condition);
+    jitRel32(a, label);
+}
+
+// a label that fails at the given offset
+uint64_t jitNewFail(JitAssembler* a, uint64_t offset) {
+    if (a -> numFails == a -> failCapacity) {
+        a -> failCapacity = (a -> failCapacity == 0) ? 16 : a -> failCapacity * 2;
+        a -> failLabels = (uint64_t*) (realloc(a -> failLabels, sizeof(uint64_t) * a -> failCapacity));
+        a -> failOffsets = (uint64_t*) (realloc(a -> failOffsets, sizeof(uint64_t) * a -> failCapacity));
+    }
+    uint64_t label = jitNewLabel(a);
+    a -> failLabels[a -> numFails] = label;
+    a -> failOffsets[a -> numFails++] = offset;
+    return label;
+}
+
+// mov rax / rcx, constant
+void jitConstant(JitAssembler* a, uint64_t value, bool intoRcx) {
+    if (value <= 0xffffffff) {
+        jitByte(a, intoRcx ? 0xB9 : 0xB8);
+        jitU32(a, (uint32_t) value);
+    }
+    else {
+        jitByte(a, 0x48);
+        jitByte(a, intoRcx ? 0xB9 : 0xB8);
+        jitU64(a, value);
+    }
+}
+
+// the rbp displacement of a parameter or local of the function being translated
+int32_t jitSlot(JitAssembler* a, uint64_t slot) {
+    Function* function = a -> function;
+    if (slot < function -> numParams) {
+        return (int32_t) (16 + 8 * (function -> numParams - 1 - slot));
+    }
+    return -(int32_t) (8 * (slot - function -> numParams + 1));
+}
+
+// the rbp displacement of the flag telling whether a local has been assigned
+int32_t jitFlag(JitAssembler* a, uint64_t slot) {
+    Function* function = a -> function;
+    uint64_t numLocals = function -> frameSize - function -> numParams;
+    return -(int32_t) (8 * (numLocals + slot - function -> numParams + 1));
+}
+
+// <opcode> reg, [rbp + displacement] (reg is the ModRM reg field: 0 = rax, 1 = rcx)
+void jitFrame(JitAssembler* a, uint8_t opcode, uint8_t reg, int32_t displacement) {
+    jitByte(a, 0x48);
+    jitByte(a, opcode);
+    jitByte(a, 0x85 | (reg << 3));
+    jitU32(a, (uint32_t) displacement);
+}
+
+// <opcode> reg, [rbx + 8 * symbol], the global with the given interned id
+void jitGlobal(JitAssembler* a, uint8_t opcode, uint8_t reg, uint64_t symbol) {
+    jitByte(a, 0x48);
+    jitByte(a, opcode);
+    jitByte(a, 0x83 | (reg << 3));
+    jitU32(a, (uint32_t) (8 * symbol));
+}
+
+// cmp qword [rbp + displacement], 0
+void jitFlagIsZero(JitAssembler* a, int32_t displacement) {
+    jitBytes(a, "\x48\x83\xBD", 3);
+    jitU32(a, (uint32_t) displacement);
+    jitByte(a, 0x00);
+}
+
+// mov qword [rbp + displacement], value
+void jitSetFlag(JitAssembler* a, int32_t displacement, uint32_t value) {
+    jitBytes(a, "\x48\xC7\x85", 3);
+    jitU32(a, (uint32_t) displacement);
+    jitU32(a, value);
+}
+
+// can the function be translated: its only calls are to itself
+bool jitSupportsExpression(Function* function, Expression* expression) {
+    if (expression == NULL) {
+        return true;
+    }
+    if (expression -> kind == EXPRESSION_CALL && expression -> symbol != function -> symbol) {
+        return false;
+    }
+    for (uint64_t i = 0; i < expression -> numArguments; i++) {
+        if (!jitSupportsExpression(function, expression -> arguments[i])) {
+            return false;
+        }
+    }
+    return jitSupportsExpression(function, expression -> left) && jitSupportsExpression(function, expression -> right);
+}
+
+bool jitSupportsBlock(Function* function, Block* block) {
+    for (uint64_t i = 0; i < block -> length; i++) {
+        Statement* s = block -> statements[i];
+        if (s -> kind == STATEMENT_FUN || !jitSupportsExpression(function, s -> expression) ||
+                !jitSupportsBlock(function, &(s -> body)) || !jitSupportsBlock(function, &(s -> elseBody))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void jitExpression(JitAssembler* a, Expression* expression);
+
+// a call to the function itself, checking the same things in the same order as the tree walker
+void jitCall(JitAssembler* a, Expression* call) {
+    if (call -> position == CALL_TAIL && call -> numArguments == a -> function -> numParams) {
+        // return f(...): overwrite the parameters and start over in the same frame
+        for (uint64_t i = 0; i < call -> numArguments; i++) {
+            jitExpression(a, call -> arguments[i]);
+            jitByte(a, 0x50);                               // push rax
+        }
+        for (uint64_t i = call -> numArguments; i > 0; i--) {
+            jitByte(a, 0x58);                               // pop rax
+            jitFrame(a, 0x89, 0, jitSlot(a, i - 1));
+        }
+        jitJump(a, a -> bodyLabel);
+        return;
+    }
+
+    uint64_t fail = jitNewFail(a, call -> end);
+
+    // test r13, r13 / jz fail (no more calls may be active)
+    jitBytes(a, "\x4D\x85\xED", 3);
+    jitJumpIf(a, JIT_EQUAL, fail);
+    // mov rcx, stackLimit / cmp rsp, rcx / jb fail
+    jitBytes(a, "\x48\xB9", 2);
+    jitU64(a, a -> jit -> stackLimit);
+    jitBytes(a, "\x48\x39\xCC", 3);
+    jitJumpIf(a, JIT_BELOW, fail);
+
+    for (uint64_t i = 0; i < call -> numArguments; i++) {
+        jitExpression(a, call -> arguments[i]);
+        jitByte(a, 0x50);                                   // push rax
+    }
+    if (call -> numArguments != a -> function -> numParams) {
+        jitJump(a, fail);
+        return;
+    }
+
+    jitBytes(a, "\x49\xFF\xCD", 3);                         // dec r13
+    jitByte(a, 0xE8);                                       // call entry
+    jitRel32(a, a -> entryLabel);
+    jitBytes(a, "\x49\xFF\xC5", 3);                         // inc r13
+    if (call -> numArguments > 0) {
+        jitBytes(a, "\x48\x81\xC4", 3);                     // add rsp, 8 * arguments
+        jitU32(a, (uint32_t) (8 * call -> numArguments));
+    }
+}
+
+// evaluates an expression into rax
+void jitExpression(JitAssembler* a, Expression* expression) {
+    switch (expression -> kind) {
+        case EXPRESSION_LITERAL:
+            jitConstant(a, expression -> value, false);
+            return;
+
+        case EXPRESSION_VARIABLE:
+            if (expression -> scope == SCOPE_GLOBAL) {
+                jitGlobal(a, 0x8B, 0, expression -> symbol);
+            }
+            else if (expression -> scope == SCOPE_PARAMETER) {
+                jitFrame(a, 0x8B, 0, jitSlot(a, expression -> slot));
+            }
+            else {
+                // utilize the local variable first, if no local variable, use global variable
+                uint64_t useGlobal = jitNewLabel(a);
+                uint64_t end = jitNewLabel(a);
+                jitFlagIsZero(a, jitFlag(a, expression -> slot));
+                jitJumpIf(a, JIT_EQUAL, useGlobal);
+                jitFrame(a, 0x8B, 0, jitSlot(a, expression -> slot));
+                jitJump(a, end);
+                jitBind(a, useGlobal);
+                jitGlobal(a, 0x8B, 0, expression -> symbol);
+                jitBind(a, end);
+            }
+            return;
+
+        case EXPRESSION_CALL:
+            jitCall(a, expression);
+            return;
+
+        case EXPRESSION_SHARE:
+            jitExpression(a, expression -> left);
+            jitFrame(a, 0x89, 0, jitSlot(a, expression -> slot));
+            return;
+
+        case EXPRESSION_NOT:
+        case EXPRESSION_TRUTH:
+            jitExpression(a, expression -> left);
+            jitBytes(a, "\x48\x85\xC0", 3);                 // test rax, rax
+            jitBytes(a, (expression -> kind == EXPRESSION_NOT) ? "\x0F\x94\xC0" : "\x0F\x95\xC0", 3);
+            jitBytes(a, "\x0F\xB6\xC0", 3);                 // movzx eax, al
+            return;
+    }
+
+    // binary operators: the left operand ends up in rax, the right one in rcx
+    jitExpression(a, expression -> left);
+    Expression* right = expression -> right;
+    if (right -> kind == EXPRESSION_LITERAL) {
+        jitConstant(a, right -> value, true);
+    }
+    else if (right -> kind == EXPRESSION_VARIABLE && right -> scope == SCOPE_PARAMETER) {
+        jitFrame(a, 0x8B, 1, jitSlot(a, right -> slot));
+    }
+    else if (right -> kind == EXPRESSION_VARIABLE && right -> scope == SCOPE_GLOBAL) {
+        jitGlobal(a, 0x8B, 1, right -> symbol);
+    }
+    else {
+        jitByte(a, 0x50);                                   // push rax
+        jitExpression(a, right);
+        jitBytes(a, "\x48\x89\xC1", 3);                     // mov rcx, rax
+        jitByte(a, 0x58);                                   // pop rax
+    }
+
+    uint8_t set = 0;
+    switch (expression -> kind) {
+        case EXPRESSION_MULTIPLY:
+            jitBytes(a, "\x48\x0F\xAF\xC1", 4);             // imul rax, rcx
+            return;
+
+        case EXPRESSION_DIVIDE:
+        case EXPRESSION_MODULO: {
+            // division by zero gives 0
+            uint64_t zero = jitNewLabel(a);
+            uint64_t end = jitNewLabel(a);
+            jitBytes(a, "\x48\x85\xC9", 3);                 // test rcx, rcx
+            jitJumpIf(a, JIT_EQUAL, zero);
+            jitBytes(a, "\x31\xD2", 2);                     // xor edx, edx
+            jitBytes(a, "\x48\xF7\xF1", 3);                 // div rcx
+            if (expression -> kind == EXPRESSION_MODULO) {
+                jitBytes(a, "\x48\x89\xD0", 3);             // mov rax, rdx
+            }
+            jitJump(a, end);
+            jitBind(a, zero);
+            jitBytes(a, "\x31\xC0", 2);                     // xor eax, eax
+            jitBind(a, end);
+            return;
+        }
+
+        case EXPRESSION_ADD:
+            jitBytes(a, "\x48\x01\xC8", 3);                 // add rax, rcx
+            return;
+
+        case EXPRESSION_SUBTRACT:
+            jitBytes(a, "\x48\x29\xC8", 3);                 // sub rax, rcx
+            return;
+
+        case EXPRESSION_AND:
+            jitBytes(a, "\x48\x85\xC0", 3);                 // test rax, rax
+            jitBytes(a, "\x0F\x95\xC0", 3);                 // setne al
+            jitBytes(a, "\x48\x85\xC9", 3);                 // test rcx, rcx
+            jitBytes(a, "\x0F\x95\xC1", 3);                 // setne cl
+            jitBytes(a, "\x20\xC8", 2);                     // and al, cl
+            jitBytes(a, "\x0F\xB6\xC0", 3);                 // movzx eax, al
+            return;
+
+        case EXPRESSION_OR:
+            jitBytes(a, "\x48\x09\xC8", 3);                 // or rax, rcx
+            jitBytes(a, "\x0F\x95\xC0", 3);                 // setne al
+            jitBytes(a, "\x0F\xB6\xC0", 3);                 // movzx eax, al
+            return;
+
+        // comparisons are unsigned, like the values
+        case EXPRESSION_LESS: set = 0x92; break;
+        case EXPRESSION_LESS_EQUAL: set = 0x96; break;
+        case EXPRESSION_GREATER: set = 0x97; break;
+        case EXPRESSION_GREATER_EQUAL: set = 0x93; break;
+        case EXPRESSION_EQUAL: set = 0x94; break;
+        case EXPRESSION_NOT_EQUAL: set = 0x95; break;
+    }
+    jitBytes(a, "\x48\x39\xC8", 3);                         // cmp rax, rcx
+    jitByte(a, 0x0F);                                       // set<condition> al
+    jitByte(a, set);
+    jitByte(a, 0xC0);
+    jitBytes(a, "\x0F\xB6\xC0", 3);                         // movzx eax, al
+}
+
+void jitStatement(JitAssembler* a, Statement* statement);
+
+void jitBlock(JitAssembler* a, Block* block) {
+    for (uint64_t i = 0; i < block -> length; i++) {
+        jitStatement(a, block -> statements[i]);
+    }
+}
+
+void jitStatement(JitAssembler* a, Statement* statement) {
+    switch (statement -> kind) {
+        case STATEMENT_ASSIGN:
+            jitExpression(a, statement -> expression);
+            if (statement -> scope == SCOPE_PARAMETER) {
+                jitFrame(a, 0x89, 0, jitSlot(a, statement -> slot));
+            }
+            else if (statement -> scope == SCOPE_LOCAL) {
+                // the local if it exists, else the global if it exists, else a new local
+                uint64_t storeLocal = jitNewLabel(a);
+                uint64_t end = jitNewLabel(a);
+                jitFlagIsZero(a, jitFlag(a, statement -> slot));
+                jitJumpIf(a, JIT_NOT_EQUAL, storeLocal);
+                jitBytes(a, "\x41\x80\xBC\x24", 4);         // cmp byte [r12 + symbol], 0
+                jitU32(a, (uint32_t) statement -> symbol);
+                jitByte(a, 0x00);
+                jitJumpIf(a, JIT_EQUAL, storeLocal);
+                jitGlobal(a, 0x89, 0, statement -> symbol);
+                jitJump(a, end);
+                jitBind(a, storeLocal);
+                jitSetFlag(a, jitFlag(a, statement -> slot), 1);
+                jitFrame(a, 0x89, 0, jitSlot(a, statement -> slot));
+                jitBind(a, end);
+            }
+            else {
+                jitGlobal(a, 0x89, 0, statement -> symbol);
+                jitBytes(a, "\x41\xC6\x84\x24", 4);         // mov byte [r12 + symbol], 1
+                jitU32(a, (uint32_t) statement -> symbol);
+                jitByte(a, 0x01);
+            }
+            return;
+
+        case STATEMENT_CALL:
+            jitExpression(a, statement -> expression);
+            return;
+
+        case STATEMENT_IF: {
+            uint64_t otherwise = jitNewLabel(a);
+            uint64_t end = jitNewLabel(a);
+            jitExpression(a, statement -> expression);
+            jitBytes(a, "\x48\x85\xC0", 3);                 // test rax, rax
+            jitJumpIf(a, JIT_EQUAL, otherwise);
+            jitBlock(a, &(statement -> body));
+            jitJump(a, end);
+            jitBind(a, otherwise);
+            jitBlock(a, &(statement -> elseBody));
+            jitBind(a, end);
+            return;
+        }
+
+        case STATEMENT_WHILE: {
+            uint64_t top = jitNewLabel(a);
+            uint64_t end = jitNewLabel(a);
+            jitBind(a, top);
+            jitExpression(a, statement -> expression);
+            jitBytes(a, "\x48\x85\xC0", 3);                 // test rax, rax
+            jitJumpIf(a, JIT_EQUAL, end);
+            jitBlock(a, &(statement -> body));
+            jitJump(a, top);
+            jitBind(a, end);
+            return;
+        }
+
+        case STATEMENT_RETURN:
+            jitExpression(a, statement -> expression);
+            jitJump(a, a -> returnLabel);
+            return;
+
+        case STATEMENT_FUN:
+            return;
+    }
+}
+
+// the C entry point: saves the callee-saved registers, loads the context,
+// pushes the arguments like a call from Fun code would and calls the body
+void jitEntry(JitAssembler* a) {
+    jitBytes(a, "\x55\x48\x89\xE5", 4);                     // push rbp / mov rbp, rsp
+    jitBytes(a, "\x53\x41\x54\x41\x55\x41\x56", 7);         // push rbx, r12, r13, r14
+    jitBytes(a, "\x48\x89\xF3", 3);                         // mov rbx, rsi
+    jitBytes(a, "\x49\x89\xD4", 3);                         // mov r12, rdx
+    jitBytes(a, "\x49\x89\xCD", 3);                         // mov r13, rcx
+    for (uint64_t i = 0; i < a -> function -> numParams; i++) {
+        jitBytes(a, "\xFF\xB7", 2);                         // push qword [rdi + 8 * i]
+        jitU32(a, (uint32_t) (8 * i));
+    }
+    jitByte(a, 0xE8);                                       // call entry
+    jitRel32(a, a -> entryLabel);
+    jitBytes(a, "\x48\x8D\x65\xE0", 4);                     // lea rsp, [rbp - 32]
+    jitBytes(a, "\x41\x5E\x41\x5D\x41\x5C\x5B\x5D", 8);     // pop r14, r13, r12, rbx, rbp
+    jitByte(a, 0xC3);                                       // ret
+}
+
+// the body, with the same frame layout as code from the -S compiler
+void jitBody(JitAssembler* a) {
+    Function* function = a -> function;
+    uint64_t numLocals = function -> frameSize - function -> numParams;
+
+    jitBind(a, a -> entryLabel);
+    jitBytes(a, "\x55\x48\x89\xE5", 4);                     // push rbp / mov rbp, rsp
+    if (numLocals > 0) {
+        jitBytes(a, "\x48\x81\xEC", 3);                     // sub rsp, 16 * locals
+        jitU32(a, (uint32_t) (16 * numLocals));
+    }
+    jitBind(a, a -> bodyLabel);
+    if (numLocals > 0) {
+        // none of the locals exist yet
+        for (uint64_t slot = function -> numParams; slot < function -> frameSize; slot++) {
+            jitSetFlag(a, jitFlag(a, slot), 0);
+        }
+    }
+
+    jitBlock(a, &(function -> body));
+
+    // if a return statement is never hit, the function returns 0
+    jitBytes(a, "\x31\xC0", 2);                             // xor eax, eax
+    jitBind(a, a -> returnLabel);
+    jitBytes(a, "\xC9\xC3", 2);                             // leave / ret
+
+    for (uint64_t i = 0; i < a -> numFails; i++) {
+        jitBind(a, a -> failLabels[i]);
+        jitBytes(a, "\x48\xBF", 2);                         // mov rdi, context
+        jitU64(a, (uint64_t) (uintptr_t) a -> jit -> failContext);
+        jitBytes(a, "\x48\xBE", 2);                         // mov rsi, offset
+        jitU64(a, a -> failOffsets[i]);
+        jitBytes(a, "\x48\xB8", 2);                         // mov rax, fail
+        jitU64(a, (uint64_t) (uintptr_t) a -> jit -> fail);
+        jitBytes(a, "\x48\x83\xE4\xF0", 4);                 // and rsp, -16
+        jitBytes(a, "\xFF\xD0", 2);                         // call rax
+    }
+}
+
+void freeJitAssembler(JitAssembler* a) {
+    free(a -> code);
+    free(a -> labels);
+    free(a -> fixupPositions);
+    free(a -> fixupLabels);
+    free(a -> failLabels);
+    free(a -> failOffsets);
+}
+
+// translates a parsed and resolved function, setting its jitEntry, or returns false if it cannot
+bool jitCompile(Jit* jit, Function* function) {
+    if (!JIT_SUPPORTED || function -> native != NULL || !jitSupportsBlock(function, &(function -> body))) {
+        return false;
+    }
+
+    JitAssembler assembler;
+    memset(&assembler, 0, sizeof(assembler));
+    JitAssembler* a = &assembler;
+    a -> jit = jit;
+    a -> function = function;
+    a -> entryLabel = jitNewLabel(a);
+    a -> returnLabel = jitNewLabel(a);
+    a -> bodyLabel = jitNewLabel(a);
+    jitEntry(a);
+    jitBody(a);
+
+    for (uint64_t i = 0; i < a -> numFixups; i++) {
+        uint64_t position = a -> fixupPositions[i];
+        int32_t rel = (int32_t) ((int64_t) a -> labels[a -> fixupLabels[i]] - (int64_t) (position + 4));
+        memcpy(a -> code + position, &rel, sizeof(rel));
+    }
+
+    // write the code into a fresh region, then make it executable instead of writable
+    void* region = mmap(NULL, a -> length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        freeJitAssembler(a);
+        return false;
+    }
+    memcpy(region, a -> code, a -> length);
+    if (mprotect(region, a -> length, PROT_READ | PROT_EXEC) != 0) {
+        munmap(region, a -> length);
+        freeJitAssembler(a);
+        return false;
+    }
+
+    if (jit -> numRegions == jit -> regionCapacity) {
+        jit -> regionCapacity = (jit -> regionCapacity == 0) ? 16 : jit -> regionCapacity * 2;
+        jit -> regions = (void**) (realloc(jit -> regions, sizeof(void*) * jit -> regionCapacity));
+        jit -> regionSizes = (uint64_t*) (realloc(jit -> regionSizes, sizeof(uint64_t) * jit -> regionCapacity));
+    }
+    jit -> regions[jit -> numRegions] = region;
+    jit -> regionSizes[jit -> numRegions++] = a -> length;
+
+    function -> jitEntry = (void*) region;
+    freeJitAssembler(a);
+    return true;
+}
+
+// counts a call to the function, translating it once it gets hot
+void jitCount(Jit* jit, Function* function) {
+    if (++(function -> calls) == JIT_THRESHOLD && jit -> enabled) {
+        jitCompile(jit, function);
+    }
+}
+
+void jitConstructor(Jit* jit, JitFail fail, void* failContext) {
+    memset(jit, 0, sizeof(Jit));
+    jit -> enabled = JIT_SUPPORTED;
+    jit -> fail = fail;
+    jit -> failContext = failContext;
+}
+
+void freeJit(Jit* jit) {
+    for (uint64_t i = 0; i < jit -> numRegions; i++) {
+        munmap(jit -> regions[i], jit -> regionSizes[i]);
+    }
+    free(jit -> regions);
+    free(jit -> regionSizes);
+}
@@ -0,0 +1,311 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "slicec.h"
+#include "mapc.h"
+
+typedef enum TokenKind {
+    TOKEN_END,              // end of the program
+    TOKEN_ERROR,            // a character that cannot start any token
+    TOKEN_COMMENT,          // # up to the end of the line, only allowed where a statement can start
+    TOKEN_IDENTIFIER,
+    TOKEN_LITERAL,
+
+    // keywords
+    TOKEN_IF,
+    TOKEN_ELSE,
+    TOKEN_WHILE,
+    TOKEN_RETURN,
+    TOKEN_FUN,
+
+    // punctuation
+    TOKEN_LEFT_PAREN,
+    TOKEN_RIGHT_PAREN,
+    TOKEN_LEFT_BRACE,
+    TOKEN_RIGHT_BRACE,
+    TOKEN_COMMA,
+    TOKEN_ASSIGN,
+
+    // operators
+    TOKEN_NOT,
+    TOKEN_STAR,
+    TOKEN_SLASH,
+    TOKEN_PERCENT,
+    TOKEN_PLUS,
+    TOKEN_MINUS,
+    TOKEN_LESS,
+    TOKEN_LESS_EQUAL,
+    TOKEN_GREATER,
+    TOKEN_GREATER_EQUAL,
+    TOKEN_EQUAL,
+    TOKEN_NOT_EQUAL,
+    TOKEN_AND,
+    TOKEN_OR
+} TokenKind;
+
+typedef struct Token {
+    uint32_t kind;
+    uint32_t offset;        // where the token starts in the program
+    uint64_t value;         // the value of a literal, the interned id of an identifier, or for a {
+                            // the index of its matching } (the TOKEN_END if it has none)
+} Token;
+
+typedef struct Lexer {
+    Token* tokens;
+    uint64_t numTokens;
+    uint64_t tokenCapacity;
+    // when the tokens were read from a cache file (cachec.h), the mapping they live in instead of malloc'd memory
+    void* mapping;
+    uint64_t mappingSize;
+
+    // every distinct identifier in the program, indexed by its interned id
+    Slice* symbols;
+    uint64_t numSymbols;
+    uint64_t symbolCapacity;
+    // maps an identifier to its interned id
+    UnorderedMap* symbolIds;
+
+    // indexes of the { tokens that have not been matched yet (more of the program may still come)
+    uint64_t* open;
+    uint64_t numOpen;
+    uint64_t openCapacity;
+} Lexer;
+
+void lexerAddToken(Lexer* lexer, uint32_t kind, uint32_t offset, uint64_t value) {
+    if (lexer -> numTokens == lexer -> tokenCapacity) {
+        lexer -> tokenCapacity *= 2;
+        lexer -> tokens = (Token*) (realloc(lexer -> tokens, sizeof(Token) * lexer -> tokenCapacity));
+    }
+    Token* token = &(lexer -> tokens[lexer -> numTokens++]);
+    token -> kind = kind;
+    token -> offset = offset;
+    token -> value = value;
+}
+
+// returns the interned id of the identifier, giving it a new id if it has not been seen before
+uint64_t lexerIntern(Lexer* lexer, Slice name) {
+    if (mapContains(lexer -> symbolIds, name)) {
+        return mapGet(lexer -> symbolIds, name);
+    }
+
+    if (lexer -> numSymbols == lexer -> symbolCapacity) {
+        lexer -> symbolCapacity *= 2;
+        lexer -> symbols = (Slice*) (realloc(lexer -> symbols, sizeof(Slice) * lexer -> symbolCapacity));
+    }
+    uint64_t id = lexer -> numSymbols++;
+    lexer -> symbols[id] = name;
+    mapInsert(lexer -> symbolIds, name, id);
+    return id;
+}
+
+// the token kind of an identifier-shaped word, which is either a keyword or a plain identifier
+uint32_t keywordKind(Slice word) {
+    if (sliceEqualString(word, "if")) {
+        return TOKEN_IF;
+    }
+    if (sliceEqualString(word, "else")) {
+        return TOKEN_ELSE;
+    }
+    if (sliceEqualString(word, "while")) {
+        return TOKEN_WHILE;
+    }
+    if (sliceEqualString(word, "return")) {
+        return TOKEN_RETURN;
+    }
+    if (sliceEqualString(word, "fun")) {
+        return TOKEN_FUN;
+    }
+    return TOKEN_IDENTIFIER;
+}
+
+// the token kind of the operator or punctuation at p, along with its length
+uint32_t symbolKind(char const *p, size_t* len) {
+    *len = 2;
+    if (p[0] == '<' && p[1] == '=') {
+        return TOKEN_LESS_EQUAL;
+    }
+    if (p[0] == '>' && p[1] == '=') {
+        return TOKEN_GREATER_EQUAL;
+    }
+    if (p[0] == '=' && p[1] == '=') {
+        return TOKEN_EQUAL;
+    }
+    if (p[0] == '!' && p[1] == '=') {
+        return TOKEN_NOT_EQUAL;
+    }
+    if (p[0] == '&' && p[1] == '&') {
+        return TOKEN_AND;
+    }
+    if (p[0] == '|' && p[1] == '|') {
+        return TOKEN_OR;
+    }
+
+    *len = 1;
+    switch (p[0]) {
+        case '(': return TOKEN_LEFT_PAREN;
+        case ')': return TOKEN_RIGHT_PAREN;
+        case '{': return TOKEN_LEFT_BRACE;
+        case '}': return TOKEN_RIGHT_BRACE;
+        case ',': return TOKEN_COMMA;
+        case '=': return TOKEN_ASSIGN;
+        case '!': return TOKEN_NOT;
+        case '*': return TOKEN_STAR;
+        case '/': return TOKEN_SLASH;
+        case '%': return TOKEN_PERCENT;
+        case '+': return TOKEN_PLUS;
+        case '-': return TOKEN_MINUS;
+        case '<': return TOKEN_LESS;
+        case '>': return TOKEN_GREATER;
+        default: return TOKEN_ERROR;
+    }
+}
+
+// turns the program from offset start up to offset end (the start of a line) into tokens, ending with a
+// TOKEN_END. Unless this is the end of the program (final, or a NUL before end), a { that is still open stays
+// open for the next call. Returns whether the end of the program was reached
+bool lexFrom(Lexer* lexer, char const *program, uint64_t start, uint64_t end, bool final) {
+    char const *current = program + start;
+    char const *limit = program + end;
+    uint64_t* open = lexer -> open;
+    uint64_t numOpen = lexer -> numOpen;
+    uint64_t openCapacity = lexer -> openCapacity;
+
+    while (true) {
+        // skip white space
+        while (current < limit && isspace(*current)) {
+            current++;
+        }
+
+        uint32_t offset = (uint32_t)(current - program);
+
+        if (current == limit || *current == 0) {
+            final = final || current < limit;
+            for (uint64_t i = 0; i < numOpen; i++) {
+                lexer -> tokens[open[i]].value = lexer -> numTokens;
+            }
+            lexer -> open = open;
+            lexer -> numOpen = final ? 0 : numOpen;
+            lexer -> openCapacity = openCapacity;
+            lexerAddToken(lexer, TOKEN_END, offset, 0);
+            return final;
+        }
+
+        if (*current == '#') {
+            // the parser decides whether a comment may be here, so it stays a token
+            do {
+                current++;
+            } while (*current != '\n' && *current != 0);
+            lexerAddToken(lexer, TOKEN_COMMENT, offset, 0);
+        }
+        else if (isalpha(*current)) {
+            char const *start = current;
+            do {
+                current++;
+            } while (isalnum(*current));
+
+            Slice word = sliceConstructorEnd(start, current);
+            uint32_t kind = keywordKind(word);
+            uint64_t id = (kind == TOKEN_IDENTIFIER) ? lexerIntern(lexer, word) : 0;
+            lexerAddToken(lexer, kind, offset, id);
+        }
+        else if (isdigit(*current)) {
+            uint64_t v = 0;
+            do {
+                v = 10 * v + (*current - '0');
+                current++;
+            } while (isdigit(*current));
+
+            lexerAddToken(lexer, TOKEN_LITERAL, offset, v);
+        }
+        else {
+            size_t len;
+            uint32_t kind = symbolKind(current, &len);
+            // a bad character becomes a TOKEN_ERROR, which only fails if the interpreter reaches it
+            if (kind == TOKEN_LEFT_BRACE) {
+                if (numOpen == openCapacity) {
+                    openCapacity = (openCapacity == 0) ? 16 : openCapacity * 2;
+                    open = (uint64_t*) (realloc(open, sizeof(uint64_t) * openCapacity));
+                }
+                open[numOpen++] = lexer -> numTokens;
+            }
+            else if (kind == TOKEN_RIGHT_BRACE && numOpen > 0) {
+                // so a block can be skipped with one lookup
+                lexer -> tokens[open[--numOpen]].value = lexer -> numTokens;
+            }
+            lexerAddToken(lexer, kind, offset, 0);
+            current += len;
+        }
+    }
+}
+
+// turns the whole program into tokens, ending with a TOKEN_END
+void lex(Lexer* lexer, char const *program) {
+    lexFrom(lexer, program, 0, strlen(program), true);
+}
+
+// replaces the TOKEN_END at the end of what was lexed so far with the tokens from start up to end
+bool lexMore(Lexer* lexer, char const *program, uint64_t start, uint64_t end, bool final) {
+    lexer -> numTokens--;
+    return lexFrom(lexer, program, start, end, final);
+}
+
+// forgets the first count tokens, which the parser is done with, and moves the rest to the front
+void lexerDrop(Lexer* lexer, uint64_t count) {
+    if (count == 0) {
+        return;
+    }
+    lexer -> numTokens -= count;
+    memmove(lexer -> tokens, lexer -> tokens + count, sizeof(Token) * lexer -> numTokens);
+    for (uint64_t i = 0; i < lexer -> numTokens; i++) {
+        if (lexer -> tokens[i].kind == TOKEN_LEFT_BRACE) {
+            lexer -> tokens[i].value -= count;
+        }
+    }
+    for (uint64_t i = 0; i < lexer -> numOpen; i++) {
+        lexer -> open[i] -= count;
+    }
+}
+
+// an empty lexer, ready for lex (or for cacheLoad to fill in)
+void lexerInit(Lexer* lexer, Arena* arena) {
+    lexer -> numTokens = 0;
+    lexer -> tokenCapacity = 256;
+    lexer -> tokens = (Token*) (malloc(sizeof(Token) * lexer -> tokenCapacity));
+    lexer -> mapping = NULL;
+    lexer -> mappingSize = 0;
+    lexer -> numSymbols = 0;
+    lexer -> symbolCapacity = 64;
+    lexer -> symbols = (Slice*) (malloc(sizeof(Slice) * lexer -> symbolCapacity));
+    lexer -> symbolIds = mapCreate(arena);
+    lexer -> open = NULL;
+    lexer -> numOpen = 0;
+    lexer -> openCapacity = 0;
+}
+
+void lexerConstructor(Lexer* lexer, char const *program, Arena* arena) {
+    lexerInit(lexer, arena);
+    lex(lexer, program);
+}
+
+// free's the lexer's token and symbol arrays (the symbol map goes with the arena)
+void freeLexer(Lexer* lexer) {
+    if (lexer -> mapping != NULL) {
+        munmap(lexer -> mapping, lexer -> mappingSize);
+    }
+    else {
+        free(lexer -> tokens);
+    }
+    free(lexer -> symbols);
+    free(lexer -> open);
+}
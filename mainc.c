@@ -6,22 +6,164 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 
 // Implementation includes
 #include "interpreterc.h"
+#include "vmc.h"
+#include "compilerc.h"
+#include "inputc.h"
+#include "batchc.h"
 // #include "interpreterc copy.h"
 
 int main(int argc, const char *const *const argv) {
 
-    if (argc != 2) {
-        fprintf(stderr,"usage: %s <file name>\n",argv[0]);
+    // which engine runs the program: the tree walker, or the bytecode vm (--vm)
+    bool useVm = false;
+    // -S: compile to x86-64 assembly on stdout instead of running the program
+    bool compile = false;
+    // --no-jit: keep hot functions in the engine instead of translating them to machine code
+    bool jit = true;
+    // --no-optimize: run the program as parsed, without folding constants or removing dead code
+    bool optimize = true;
+    // --memo: cache the values of calls to pure functions, --memo-size: how many
+    bool memo = false;
+    uint64_t memoSize = MEMO_DEFAULT_SIZE;
+    // --batch: run every program named (or listed on stdin) on --jobs threads
+    bool batch = false;
+    uint64_t jobs = 0;
+    // --profile: report time and counts per function and line on stderr, --profile-stacks: also write folded stacks here
+    bool profile = false;
+    const char* stacksName = NULL;
+    // --stats: report counts of the interpreter's work on stderr, --stats-json: write them to this file instead
+    bool showStats = false;
+    const char* statsName = NULL;
+    // --cache: keep the program's tokens in this directory, so the next run of the same source skips lexing
+    const char* cacheDirectory = NULL;
+    // how many calls may be active at once (0 keeps the interpreter's default)
+    uint64_t maxDepth = 0;
+    // the program, or stdin when there is none (or it is -); with --batch, all of them
+    const char* fileName = NULL;
+    const char** fileNames = (const char**) (malloc(sizeof(char*) * argc));
+    uint64_t numFiles = 0;
+    bool badArguments = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--vm") == 0) {
+            useVm = true;
+        }
+        else if (strcmp(argv[i], "-S") == 0) {
+            compile = true;
+        }
+        else if (strcmp(argv[i], "--no-optimize") == 0) {
+            optimize = false;
+        }
+        else if (strcmp(argv[i], "--no-jit") == 0) {
+            jit = false;
+        }
+        else if (strcmp(argv[i], "--memo") == 0) {
+            memo = true;
+        }
+        else if (strcmp(argv[i], "--memo-size") == 0 && i + 1 < argc && isdigit(argv[i + 1][0])) {
+            memo = true;
+            memoSize = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--profile") == 0) {
+            profile = true;
+        }
+        else if (strcmp(argv[i], "--profile-stacks") == 0 && i + 1 < argc) {
+            profile = true;
+            stacksName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--stats") == 0) {
+            showStats = true;
+        }
+        else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc) {
+            showStats = true;
+            statsName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cacheDirectory = argv[++i];
+        }
+        else if (strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+        }
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc && isdigit(argv[i + 1][0])) {
+            jobs = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc && isdigit(argv[i + 1][0])) {
+            maxDepth = strtoull(argv[++i], NULL, 10);
+        }
+        else if (argv[i][0] != '-' || strcmp(argv[i], "-") == 0) {
+            fileName = argv[i];
+            fileNames[numFiles++] = argv[i];
+        }
+        else {
+            badArguments = true;
+            break;
+        }
+    }
+
+    // only the tree walker is profiled or counted, and a batch is only run
+    if (badArguments || (!batch && numFiles > 1) || ((profile || showStats) && (useVm || compile)) ||
+            (batch && (profile || showStats || compile))) {
+        fprintf(stderr,"usage: %s [--vm | -S] [--no-optimize] [--no-jit] [--memo] [--memo-size <entries>] [--profile] [--profile-stacks <file>] [--stats] [--stats-json <file>] [--cache <directory>] [--max-depth <calls>] [<file name> | -]\n"
+            "       %s --batch [--jobs <threads>] [--vm] [--no-optimize] [--no-jit] [--memo] [--memo-size <entries>] [--cache <directory>] [--max-depth <calls>] [<file name> ...]\n",argv[0],argv[0]);
         exit(1);
     }
+    if (showStats && !STATS_ENABLED) {
+        fprintf(stderr, "%s: built without statistics, use build/main-stats (make build/main-stats)\n", argv[0]);
+        exit(1);
+    }
+
+    EngineOptions options;
+    options.useVm = useVm;
+    // (machine code would hide the calls it makes from the profiler and the counters)
+    options.jit = jit && !profile && !showStats;
+    options.optimize = optimize;
+    options.memoSize = memo ? memoSize : 0;
+    options.maxDepth = maxDepth;
+    options.cacheDirectory = cacheDirectory;
+
+    if (batch) {
+        // without names on the command line, one per line on stdin
+        Input list;
+        bool listed = numFiles == 0;
+        if (listed) {
+            inputConstructor(&list, STDIN_FILENO);
+            inputReadAll(&list);
+            fileNames = (const char**) (realloc(fileNames, sizeof(char*) * (list.length / 2 + 1)));
+            char* name = list.buffer;
+            for (uint64_t i = 0; i <= list.length; i++) {
+                if (list.buffer[i] == '\n' || i == list.length) {
+                    list.buffer[i] = 0;
+                    if (*name != 0) {
+                        fileNames[numFiles++] = name;
+                    }
+                    name = list.buffer + i + 1;
+                }
+            }
+        }
+        if (jobs == 0) {
+            long online = sysconf(_SC_NPROCESSORS_ONLN);
+            jobs = (online > 0) ? (uint64_t) online : 1;
+        }
+        uint64_t failed = runBatch(fileNames, numFiles, jobs, &options);
+        if (failed > 0) {
+            fprintf(stderr, "%lu of %lu programs failed\n", (unsigned long) failed, (unsigned long) numFiles);
+        }
+        free(fileNames);
+        if (listed) {
+            freeInput(&list);
+        }
+        return (failed > 0) ? 1 : 0;
+    }
+    free(fileNames);
 
     // open the file
-    int fd = open(argv[1],O_RDONLY);
+    int fd = (fileName == NULL || strcmp(fileName, "-") == 0) ? STDIN_FILENO : open(fileName,O_RDONLY);
     if (fd < 0) {
         perror("open");
         exit(1);
@@ -35,28 +177,88 @@ int main(int argc, const char *const *const argv) {
         exit(1);
     }
 
-    // map the file in my address space
-    char* prog = (char *)mmap(
-        0,
-        file_stats.st_size,
-        PROT_READ,
-        MAP_PRIVATE,
-        fd,
-        0);
-    if (prog == MAP_FAILED) {
-        perror("mmap");
-        exit(1);
+    // a pipe (or anything else that cannot be mapped) is read as the program runs: each top-level statement
+    // runs once it has arrived. The cache and the profiler need the whole program first
+    bool streamed = !S_ISREG(file_stats.st_mode) || file_stats.st_size == 0;
+    Input input;
+    char* prog;
+    if (streamed) {
+        inputConstructor(&input, fd);
+        if (cacheDirectory != NULL || profile) {
+            inputReadAll(&input);
+            input.lexedAll = true;
+        }
+        prog = input.buffer;
+    }
+    else {
+        // map the file in my address space
+        prog = (char *)mmap(
+            0,
+            file_stats.st_size,
+            PROT_READ,
+            MAP_PRIVATE,
+            fd,
+            0);
+        if (prog == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
     }
 
-    Interpreter* interpreter = interpreterConstructor(prog);
-    
-    run(interpreter);
+    Interpreter* interpreter = interpreterConstructor(prog, cacheDirectory, &file_stats);
+    if (streamed && !input.lexedAll) {
+        interpreter -> parser.input = &input;
+    }
+    engineConfigure(interpreter, &options);
+    if (profile) {
+        profileEnable(&(interpreter -> profiler));
+    }
+
+    if (compile) {
+        compileProgram(interpreter);
+    }
+    else if (useVm) {
+        Vm* vm = vmConstructor(interpreter);
+        runVm(vm);
+        freeVm(vm);
+    }
+    else {
+        run(interpreter);
+    }
+
+    if (profile) {
+        outputFlush(&(interpreter -> output));
+        profileReport(&(interpreter -> profiler), stderr, interpreter -> parser.lexer.symbols);
+        FILE* stacks = (stacksName == NULL) ? NULL : fopen(stacksName, "w");
+        if (stacksName != NULL && stacks == NULL) {
+            perror("fopen");
+        }
+        else if (stacks != NULL) {
+            profileWriteStacks(&(interpreter -> profiler), stacks, interpreter -> parser.lexer.symbols);
+            fclose(stacks);
+        }
+    }
+
+    if (showStats) {
+        outputFlush(&(interpreter -> output));
+        FILE* out = (statsName == NULL) ? stderr : fopen(statsName, "w");
+        if (out == NULL) {
+            perror("fopen");
+        }
+        else if (statsName == NULL) {
+            statsReport(out);
+        }
+        else {
+            statsWriteJson(out);
+            fclose(out);
+        }
+    }
 
     // deallocate space to reduce memory leaks
-    freeMap(interpreter -> symbolTable);
-    freeMap(interpreter -> currentSymbolTable);
-    functionFreeMap(interpreter -> functionNameMap);    
-    free(interpreter);
+    freeInterpreter(interpreter);
+    if (streamed) {
+        freeInput(&input);
+    }
 
     return 0;
 }
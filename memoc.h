@@ -0,0 +1,434 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Implementation includes
+#include "astc.h"
+
+// --memo: calls to pure functions are answered from a cache keyed by the
+// function and its arguments, which turns naive recursions (fib, binomial
+// coefficients, path counting) from exponential into linear.
+//
+// A function is pure when neither it nor any function it can end up calling
+// reads or assigns a global or calls a builtin (print). Its value then only
+// depends on its arguments, with one exception: a local assigned while the
+// global of the same name exists updates that global instead, and reads it
+// until then. So every call also checks that none of those names exists as a
+// global right now (the guard), and calls normally if one does.
+//
+// The same analysis tells the evaluator when the right operand of && or ||
+// can be skipped (see rightSkippable): a function is effect-free when neither
+// it nor anything it can call assigns a global or calls a builtin, under the
+// same guard. Reading globals is fine there. Skipping also needs the call to be
+// sure to return without going past --max-depth, so memoCallDepth finds how
+// deep a call can go, for functions that can reach no loop and no recursion.
+//
+// Which function a call reaches is decided by name when the call runs, so the
+// analysis is redone whenever a function is declared or parsed, and the cache
+// is emptied when a declaration replaces a function.
+//
+// The cache holds --memo-size entries and is direct mapped: an entry that
+// lands on a used slot replaces what was there.
+
+#define MEMO_DEFAULT_SIZE (64 * 1024)
+// functions with more parameters are never cached
+#define MEMO_MAX_ARGUMENTS 4
+
+typedef struct Purity {
+    // from the function's own body, filled in once it has been parsed
+    bool scanned;
+    bool readsGlobals;
+    bool writesGlobals;
+    bool loops;                         // it has a while loop
+    Expression** calls;                 // the calls it makes
+    uint64_t numCalls;
+    uint64_t* locals;                   // interned ids of its locals
+    uint64_t numLocals;
+
+    // the function and everything it can call, as of analysisEpoch
+    uint64_t analysisEpoch;
+    bool memoizable;
+    bool effectFree;
+    uint64_t* guards;                   // the locals of all of them
+    uint64_t numGuards;
+
+    uint64_t visit;                     // last analysis that reached the function
+
+    // as of depthEpoch: the most calls that can be active at once while a call of it runs, counting
+    // itself, or 0 if the call might never return (it can reach a loop or a recursion)
+    uint64_t depthEpoch;
+    uint64_t callDepth;
+    bool onPath;                        // during memoCallDepth: on the chain of calls being followed
+    uint64_t nextCall;                  // during memoCallDepth: the next of its calls to follow
+} Purity;
+
+typedef struct MemoEntry {
+    Function* function;                 // NULL for an empty slot
+    uint64_t arguments[MEMO_MAX_ARGUMENTS];
+    uint64_t value;
+} MemoEntry;
+
+typedef struct Memo {
+    bool enabled;
+    uint64_t size;                      // entries the cache may hold
+    MemoEntry* entries;
+    uint64_t mask;
+    bool empty;
+
+    // bumped whenever a function is declared or parsed, so the analyses are redone
+    uint64_t epoch;
+    uint64_t visit;
+
+    // scratch space for an analysis
+    Function** pending;
+    uint64_t numPending;
+    uint64_t pendingCapacity;
+    uint64_t* guards;
+    uint64_t numGuards;
+    uint64_t guardCapacity;
+
+    Arena* arena;
+} Memo;
+
+void memoAppend(uint64_t** array, uint64_t* length, uint64_t* capacity, uint64_t value) {
+    if (*length == *capacity) {
+        *capacity = (*capacity == 0) ? 16 : *capacity * 2;
+        *array = (uint64_t*) (realloc(*array, sizeof(uint64_t) * *capacity));
+    }
+    (*array)[(*length)++] = value;
+}
+
+// the names a function body reads, assigns and calls
+typedef struct PurityScan {
+    bool readsGlobals;
+    bool writesGlobals;
+    bool loops;
+    Expression** calls;
+    uint64_t numCalls;
+    uint64_t callCapacity;
+    uint64_t* locals;
+    uint64_t numLocals;
+    uint64_t localCapacity;
+} PurityScan;
+
+void scanName(PurityScan* scan, uint32_t scope, uint64_t symbol, bool assigned) {
+    if (scope == SCOPE_GLOBAL) {
+        if (assigned) {
+            scan -> writesGlobals = true;
+        }
+        else {
+            scan -> readsGlobals = true;
+        }
+    }
+    else if (scope == SCOPE_LOCAL) {
+        memoAppend(&(scan -> locals), &(scan -> numLocals), &(scan -> localCapacity), symbol);
+    }
+}
+
+void scanExpression(PurityScan* scan, Expression* expression) {
+    if (expression == NULL) {
+        return;
+    }
+    if (expression -> kind == EXPRESSION_VARIABLE) {
+        scanName(scan, expression -> scope, expression -> symbol, false);
+    }
+    if (expression -> kind == EXPRESSION_CALL) {
+        if (scan -> numCalls == scan -> callCapacity) {
+            scan -> callCapacity = (scan -> callCapacity == 0) ? 16 : scan -> callCapacity * 2;
+            scan -> calls = (Expression**) (realloc(scan -> calls, sizeof(Expression*) * scan -> callCapacity));
+        }
+        scan -> calls[scan -> numCalls++] = expression;
+    }
+    for (uint64_t i = 0; i < expression -> numArguments; i++) {
+        scanExpression(scan, expression -> arguments[i]);
+    }
+    scanExpression(scan, expression -> left);
+    scanExpression(scan, expression -> right);
+}
+
+void scanBlock(PurityScan* scan, Block* block) {
+    for (uint64_t i = 0; i < block -> length; i++) {
+        Statement* s = block -> statements[i];
+        if (s -> kind == STATEMENT_ASSIGN) {
+            scanName(scan, s -> scope, s -> symbol, true);
+        }
+        if (s -> kind == STATEMENT_WHILE) {
+            scan -> loops = true;
+        }
+        scanExpression(scan, s -> expression);
+        scanBlock(scan, &(s -> body));
+        scanBlock(scan, &(s -> elseBody));
+    }
+}
+
+// copies a scratch array into the arena
+uint64_t* memoKeep(Memo* memo, uint64_t* values, uint64_t length) {
+    uint64_t* kept = (uint64_t*) (arenaAlloc(memo -> arena, sizeof(uint64_t) * length));
+    if (length > 0) {
+        memcpy(kept, values, sizeof(uint64_t) * length);
+    }
+    return kept;
+}
+
+Purity* purityOf(Memo* memo, Function* function) {
+    if (function -> purity == NULL) {
+        function -> purity = (Purity*) (arenaCalloc(memo -> arena, sizeof(Purity)));
+    }
+    Purity* purity = function -> purity;
+    if (!purity -> scanned && function -> parsed && function -> native == NULL) {
+        PurityScan scan;
+        memset(&scan, 0, sizeof(scan));
+        scanBlock(&scan, &(function -> body));
+        purity -> readsGlobals = scan.readsGlobals;
+        purity -> writesGlobals = scan.writesGlobals;
+        purity -> loops = scan.loops;
+        purity -> calls = (Expression**) (arenaAlloc(memo -> arena, sizeof(Expression*) * scan.numCalls));
+        if (scan.numCalls > 0) {
+            memcpy(purity -> calls, scan.calls, sizeof(Expression*) * scan.numCalls);
+        }
+        purity -> numCalls = scan.numCalls;
+        purity -> locals = memoKeep(memo, scan.locals, scan.numLocals);
+        purity -> numLocals = scan.numLocals;
+        purity -> scanned = true;
+        free(scan.calls);
+        free(scan.locals);
+    }
+    return purity;
+}
+
+// decides whether calls to the function can be cached or skipped, looking at every function it can reach
+void memoAnalyze(Memo* memo, Function* function, Function** functions) {
+    Purity* purity = purityOf(memo, function);
+    purity -> analysisEpoch = memo -> epoch;
+    purity -> memoizable = false;
+    purity -> effectFree = false;
+    bool readsGlobals = false;
+
+    memo -> visit++;
+    memo -> numPending = 0;
+    memo -> numGuards = 0;
+    purity -> visit = memo -> visit;
+    if (memo -> pendingCapacity == 0) {
+        memo -> pendingCapacity = 16;
+        memo -> pending = (Function**) (malloc(sizeof(Function*) * memo -> pendingCapacity));
+    }
+    memo -> pending[memo -> numPending++] = function;
+
+    while (memo -> numPending > 0) {
+        Function* reached = memo -> pending[--(memo -> numPending)];
+        Purity* p = purityOf(memo, reached);
+        // builtins have effects, and a body that was never parsed is unknown
+        if (reached -> native != NULL || !p -> scanned || p -> writesGlobals) {
+            return;
+        }
+        readsGlobals = readsGlobals || p -> readsGlobals;
+        for (uint64_t i = 0; i < p -> numLocals; i++) {
+            memoAppend(&(memo -> guards), &(memo -> numGuards), &(memo -> guardCapacity), p -> locals[i]);
+        }
+        for (uint64_t i = 0; i < p -> numCalls; i++) {
+            // a call that would fail is an effect too
+            Function* callee = functions[p -> calls[i] -> symbol];
+            if (callee == NULL || callee -> numParams != p -> calls[i] -> numArguments) {
+                return;
+            }
+            Purity* q = purityOf(memo, callee);
+            if (q -> visit != memo -> visit) {
+                q -> visit = memo -> visit;
+                if (memo -> numPending == memo -> pendingCapacity) {
+                    memo -> pendingCapacity *= 2;
+                    memo -> pending = (Function**) (realloc(memo -> pending, sizeof(Function*) * memo -> pendingCapacity));
+                }
+                memo -> pending[memo -> numPending++] = callee;
+            }
+        }
+    }
+
+    purity -> memoizable = !readsGlobals;
+    purity -> effectFree = true;
+    purity -> guards = memoKeep(memo, memo -> guards, memo -> numGuards);
+    purity -> numGuards = memo -> numGuards;
+}
+
+// the function's analysis, redone if a function was declared or parsed since
+Purity* memoAnalysis(Memo* memo, Function* function, Function** functions) {
+    if (function -> purity == NULL || function -> purity -> analysisEpoch != memo -> epoch) {
+        memoAnalyze(memo, function, functions);
+    }
+    return function -> purity;
+}
+
+// adds what a call the function makes can reach to the function's depth, 0 if that call might never return
+void memoAddCallDepth(Purity* purity, uint64_t calleeDepth) {
+    if (calleeDepth == 0) {
+        purity -> callDepth = 0;
+    }
+    else if (purity -> callDepth != 0 && calleeDepth + 1 > purity -> callDepth) {
+        purity -> callDepth = calleeDepth + 1;
+    }
+}
+
+// the most calls that can be active at once while a call of the function runs (counting it), or 0 if the call
+// might never return or might fail: it can reach a loop, a recursion, a builtin, a body that was never parsed
+// or a call that fails. Follows the calls depth first, with a stack of its own so a long chain of functions
+// does not use up the C stack
+uint64_t memoCallDepth(Memo* memo, Function* function, Function** functions) {
+    Purity* purity = purityOf(memo, function);
+    if (purity -> depthEpoch == memo -> epoch) {
+        return purity -> callDepth;
+    }
+
+    memo -> numPending = 0;
+    if (memo -> pendingCapacity == 0) {
+        memo -> pendingCapacity = 16;
+        memo -> pending = (Function**) (malloc(sizeof(Function*) * memo -> pendingCapacity));
+    }
+    Function* reached = function;
+    while (true) {
+        // start on a function that has not been seen in this epoch
+        Purity* p = purityOf(memo, reached);
+        p -> depthEpoch = memo -> epoch;
+        p -> callDepth = (reached -> native != NULL || !p -> scanned || p -> loops) ? 0 : 1;
+        p -> nextCall = 0;
+        p -> onPath = true;
+        if (memo -> numPending == memo -> pendingCapacity) {
+            memo -> pendingCapacity *= 2;
+            memo -> pending = (Function**) (realloc(memo -> pending, sizeof(Function*) * memo -> pendingCapacity));
+        }
+        memo -> pending[memo -> numPending++] = reached;
+
+        // follow its calls until one reaches a function that has not been seen, or all of them are done
+        reached = NULL;
+        while (reached == NULL && memo -> numPending > 0) {
+            Function* top = memo -> pending[memo -> numPending - 1];
+            Purity* t = top -> purity;
+            if (t -> callDepth == 0 || t -> nextCall == t -> numCalls) {
+                t -> onPath = false;
+                memo -> numPending--;
+                if (memo -> numPending > 0) {
+                    memoAddCallDepth(memo -> pending[memo -> numPending - 1] -> purity, t -> callDepth);
+                }
+                continue;
+            }
+            Expression* call = t -> calls[t -> nextCall++];
+            Function* callee = functions[call -> symbol];
+            if (callee == NULL || callee -> numParams != call -> numArguments) {
+                t -> callDepth = 0;
+                continue;
+            }
+            Purity* q = purityOf(memo, callee);
+            if (q -> depthEpoch != memo -> epoch) {
+                reached = callee;
+            }
+            else {
+                // a function on the chain being followed is a recursion
+                memoAddCallDepth(t, q -> onPath ? 0 : q -> callDepth);
+            }
+        }
+        if (reached == NULL) {
+            return purity -> callDepth;
+        }
+    }
+}
+
+// does a global exist with the name of a local the function (or one it calls) assigns
+bool memoGuarded(Purity* purity, bool* globalDefined) {
+    for (uint64_t i = 0; i < purity -> numGuards; i++) {
+        if (globalDefined[purity -> guards[i]]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// can this call of the function be answered from the cache
+bool memoUsable(Memo* memo, Function* function, Function** functions, bool* globalDefined) {
+    if (!memo -> enabled || function -> native != NULL || function -> numParams > MEMO_MAX_ARGUMENTS) {
+        return false;
+    }
+    Purity* purity = memoAnalysis(memo, function, functions);
+    return purity -> memoizable && !memoGuarded(purity, globalDefined);
+}
+
+// can calling the function right now change anything besides its own frame
+bool hasEffects(Memo* memo, Function* function, Function** functions, bool* globalDefined) {
+    if (function -> native != NULL) {
+        return true;
+    }
+    Purity* purity = memoAnalysis(memo, function, functions);
+    return !purity -> effectFree || memoGuarded(purity, globalDefined);
+}
+
+MemoEntry* memoSlot(Memo* memo, Function* function, uint64_t* arguments) {
+    uint64_t hash = (uint64_t) (uintptr_t) function;
+    for (uint64_t i = 0; i < function -> numParams; i++) {
+        hash = (hash ^ arguments[i]) * 0x100000001b3;
+        hash ^= hash >> 29;
+    }
+    return &(memo -> entries[hash & memo -> mask]);
+}
+
+// looks the call up, true (and the value) if it is cached
+bool memoFind(Memo* memo, Function* function, uint64_t* arguments, uint64_t* value) {
+    MemoEntry* entry = memoSlot(memo, function, arguments);
+    if (entry -> function != function ||
+            memcmp(entry -> arguments, arguments, sizeof(uint64_t) * function -> numParams) != 0) {
+        return false;
+    }
+    *value = entry -> value;
+    return true;
+}
+
+void memoStore(Memo* memo, Function* function, uint64_t* arguments, uint64_t value) {
+    MemoEntry* entry = memoSlot(memo, function, arguments);
+    entry -> function = function;
+    memcpy(entry -> arguments, arguments, sizeof(uint64_t) * function -> numParams);
+    entry -> value = value;
+    memo -> empty = false;
+}
+
+// a function was declared (replacing: whether it replaced another one) or parsed
+void memoInvalidate(Memo* memo, bool replacing) {
+    memo -> epoch++;
+    if (replacing && !memo -> empty) {
+        memset(memo -> entries, 0, sizeof(MemoEntry) * (memo -> mask + 1));
+        memo -> empty = true;
+    }
+}
+
+// turns caching on, with room for about size entries
+void memoEnable(Memo* memo, uint64_t size) {
+    uint64_t capacity = 1;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    free(memo -> entries);
+    memo -> entries = (MemoEntry*) (calloc(capacity, sizeof(MemoEntry)));
+    memo -> mask = capacity - 1;
+    memo -> size = size;
+    memo -> empty = true;
+    memo -> enabled = true;
+}
+
+void memoConstructor(Memo* memo, Arena* arena) {
+    memset(memo, 0, sizeof(Memo));
+    memo -> arena = arena;
+    memo -> size = MEMO_DEFAULT_SIZE;
+    // there is no table to clear until memoEnable
+    memo -> empty = true;
+}
+
+void freeMemo(Memo* memo) {
+    free(memo -> entries);
+    free(memo -> pending);
+    free(memo -> guards);
+}
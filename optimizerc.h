@@ -0,0 +1,689 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Implementation includes
+#include "astc.h"
+
+// The optimizer runs over every function body after the resolver, and over
+// every top-level statement with a loop in it (the others run once, so
+// optimizing them would take about as long as running them as parsed). All
+// the engines run the optimized tree:
+//
+//      * constant folding: operators on literals become literals, with the
+//        same wrapping arithmetic and division by zero giving 0 as evaluate()
+//      * dead code: an if with a constant condition is replaced by the branch
+//        that runs, a while (0) disappears, and so does everything in a block
+//        after a return
+//      * common subexpressions: inside a function, an operator on variables
+//        that shows up again later in the same statement with no call in
+//        between is computed once. The first copy becomes an
+//        EXPRESSION_SHARE, which also stores its value in a temporary slot of
+//        the frame, and the later copies read that slot
+//      * the right operand of && and || is marked skippable, with the calls
+//        in it, so the evaluator can leave it out once the left operand
+//        decides the result and none of those calls has an effect
+//      * shapes: x = x + literal, x = x + <expression without calls> and
+//        if / while on a comparison of variables and literals are marked, so
+//        the tree walker runs them in one step (see StatementShape). So are
+//        counted loops, while (i < n) { ...; i = i + k } where nothing else
+//        in the loop assigns i or n
+//      * loop-invariant code motion: inside a function, an operator without
+//        calls whose variables no statement of a loop can change is computed
+//        once before the loop, into a slot of the frame after the
+//        temporaries, and the loop reads that slot
+//
+// --no-optimize turns it off, so results can be checked against the tree as parsed.
+
+// how many subexpressions of one statement are remembered for reuse
+#define OPTIMIZER_MAX_AVAILABLE 256
+
+typedef struct Optimizer {
+    bool enabled;
+    Arena* arena;
+
+    // the function being optimized, NULL at the top level (which has no frame for temporaries)
+    Function* function;
+    uint64_t firstTemporary;            // slot of the first temporary, right after the locals
+    uint64_t numTemporaries;            // temporaries used by the statement being optimized
+    uint64_t maxTemporaries;
+
+    // operators seen so far in the statement that later copies can reuse,
+    // and the EXPRESSION_SHARE each was turned into once a copy showed up (or NULL)
+    Expression* available[OPTIMIZER_MAX_AVAILABLE];
+    Expression* shares[OPTIMIZER_MAX_AVAILABLE];
+    uint64_t numAvailable;
+
+    // scratch space for the calls in the right operand of && and ||
+    Expression** calls;
+    uint64_t numCalls;
+    uint64_t callCapacity;
+
+    // what the loop being looked at assigns: locals and globals by interned
+    // id, parameters and frame slots by slot, and whether it makes calls
+    uint64_t* writtenSymbols;
+    uint64_t numWrittenSymbols;
+    uint64_t writtenSymbolCapacity;
+    uint64_t* writtenSlots;
+    uint64_t numWrittenSlots;
+    uint64_t writtenSlotCapacity;
+    bool loopCalls;
+
+    // values moved out of loops get the frame slots from firstHoisted on
+    uint64_t firstHoisted;
+    uint64_t numHoisted;
+} Optimizer;
+
+void optimizerAppend(uint64_t** array, uint64_t* length, uint64_t* capacity, uint64_t value) {
+    if (*length == *capacity) {
+        *capacity = (*capacity == 0) ? 16 : *capacity * 2;
+        *array = (uint64_t*) (realloc(*array, sizeof(uint64_t) * *capacity));
+    }
+    (*array)[(*length)++] = value;
+}
+
+// the same arithmetic as evaluate()
+uint64_t foldBinary(uint32_t kind, uint64_t v, uint64_t u) {
+    switch (kind) {
+        case EXPRESSION_MULTIPLY: return v * u;
+        case EXPRESSION_DIVIDE: return (u == 0) ? 0 : v / u;
+        case EXPRESSION_MODULO: return (u == 0) ? 0 : v % u;
+        case EXPRESSION_ADD: return v + u;
+        case EXPRESSION_SUBTRACT: return v - u;
+        case EXPRESSION_LESS: return (v < u) ? 1 : 0;
+        case EXPRESSION_LESS_EQUAL: return (v <= u) ? 1 : 0;
+        case EXPRESSION_GREATER: return (v > u) ? 1 : 0;
+        case EXPRESSION_GREATER_EQUAL: return (v >= u) ? 1 : 0;
+        case EXPRESSION_EQUAL: return (v == u) ? 1 : 0;
+        case EXPRESSION_NOT_EQUAL: return (v != u) ? 1 : 0;
+        case EXPRESSION_AND: return (v && u) ? 1 : 0;
+        case EXPRESSION_OR: return (v || u) ? 1 : 0;
+    }
+    return 0;
+}
+
+uint64_t mixHash(uint64_t hash, uint64_t value) {
+    hash ^= value + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+// folds the constants in an expression and fills in pure and hash, returns what replaces it
+Expression* foldExpression(Optimizer* optimizer, Expression* expression) {
+    uint64_t hash = mixHash(0, expression -> kind);
+    bool pure = (expression -> kind != EXPRESSION_CALL);
+
+    for (uint64_t i = 0; i < expression -> numArguments; i++) {
+        expression -> arguments[i] = foldExpression(optimizer, expression -> arguments[i]);
+        hash = mixHash(hash, expression -> arguments[i] -> hash);
+    }
+    if (expression -> left != NULL) {
+        expression -> left = foldExpression(optimizer, expression -> left);
+        hash = mixHash(hash, expression -> left -> hash);
+        pure = pure && expression -> left -> pure;
+    }
+    if (expression -> right != NULL) {
+        expression -> right = foldExpression(optimizer, expression -> right);
+        hash = mixHash(hash, expression -> right -> hash);
+        pure = pure && expression -> right -> pure;
+    }
+
+    Expression* left = expression -> left;
+    Expression* right = expression -> right;
+    switch (expression -> kind) {
+        case EXPRESSION_LITERAL:
+            hash = mixHash(hash, expression -> value);
+            break;
+
+        case EXPRESSION_VARIABLE:
+            hash = mixHash(mixHash(hash, expression -> symbol), expression -> scope);
+            break;
+
+        case EXPRESSION_CALL:
+            hash = mixHash(hash, expression -> symbol);
+            break;
+
+        case EXPRESSION_NOT:
+        case EXPRESSION_TRUTH:
+            if (left -> kind == EXPRESSION_LITERAL) {
+                expression -> value = ((left -> value != 0) == (expression -> kind == EXPRESSION_TRUTH)) ? 1 : 0;
+                expression -> kind = EXPRESSION_LITERAL;
+            }
+            break;
+
+        default:
+            if (left -> kind == EXPRESSION_LITERAL && right -> kind == EXPRESSION_LITERAL) {
+                expression -> value = foldBinary(expression -> kind, left -> value, right -> value);
+                expression -> kind = EXPRESSION_LITERAL;
+            }
+            // x + 0, x - 0, x * 1 and x / 1 are just x (still evaluated, in case it calls something)
+            else if (right -> kind == EXPRESSION_LITERAL &&
+                    ((right -> value == 0 && (expression -> kind == EXPRESSION_ADD || expression -> kind == EXPRESSION_SUBTRACT)) ||
+                    (right -> value == 1 && (expression -> kind == EXPRESSION_MULTIPLY || expression -> kind == EXPRESSION_DIVIDE)))) {
+                return left;
+            }
+            else if (left -> kind == EXPRESSION_LITERAL &&
+                    ((left -> value == 0 && expression -> kind == EXPRESSION_ADD) ||
+                    (left -> value == 1 && expression -> kind == EXPRESSION_MULTIPLY))) {
+                return right;
+            }
+            break;
+    }
+
+    if (expression -> kind == EXPRESSION_LITERAL) {
+        // folded (or always was), forget the operands
+        expression -> left = NULL;
+        expression -> right = NULL;
+        hash = mixHash(mixHash(0, EXPRESSION_LITERAL), expression -> value);
+        pure = true;
+    }
+    expression -> hash = hash;
+    expression -> pure = pure;
+    return expression;
+}
+
+void collectCalls(Optimizer* optimizer, Expression* expression) {
+    if (expression -> kind == EXPRESSION_CALL) {
+        if (optimizer -> numCalls == optimizer -> callCapacity) {
+            optimizer -> callCapacity = (optimizer -> callCapacity == 0) ? 16 : optimizer -> callCapacity * 2;
+            optimizer -> calls = (Expression**) (realloc(optimizer -> calls, sizeof(Expression*) * optimizer -> callCapacity));
+        }
+        optimizer -> calls[optimizer -> numCalls++] = expression;
+    }
+    for (uint64_t i = 0; i < expression -> numArguments; i++) {
+        collectCalls(optimizer, expression -> arguments[i]);
+    }
+    if (expression -> left != NULL && expression -> kind != EXPRESSION_VARIABLE) {
+        collectCalls(optimizer, expression -> left);
+    }
+    if (expression -> right != NULL) {
+        collectCalls(optimizer, expression -> right);
+    }
+}
+
+// marks the right operand of every && and || as skippable, and lists the calls in it
+void markSkippable(Optimizer* optimizer, Expression* expression) {
+    for (uint64_t i = 0; i < expression -> numArguments; i++) {
+        markSkippable(optimizer, expression -> arguments[i]);
+    }
+    if (expression -> left != NULL && expression -> kind != EXPRESSION_VARIABLE) {
+        markSkippable(optimizer, expression -> left);
+    }
+    if (expression -> right != NULL) {
+        markSkippable(optimizer, expression -> right);
+    }
+    if (expression -> kind != EXPRESSION_AND && expression -> kind != EXPRESSION_OR) {
+        return;
+    }
+    optimizer -> numCalls = 0;
+    collectCalls(optimizer, expression -> right);
+    uint64_t numCalls = optimizer -> numCalls;
+    expression -> calls = (Expression**) (arenaAlloc(optimizer -> arena, sizeof(Expression*) * (numCalls + 1)));
+    if (numCalls > 0) {
+        memcpy(expression -> calls, optimizer -> calls, sizeof(Expression*) * numCalls);
+    }
+    expression -> calls[numCalls] = NULL;
+}
+
+// what an expression computes, looking through the nodes common subexpression elimination made
+Expression* sharedValue(Expression* expression) {
+    if (expression -> kind == EXPRESSION_SHARE ||
+            (expression -> kind == EXPRESSION_VARIABLE && expression -> left != NULL)) {
+        return expression -> left;
+    }
+    return expression;
+}
+
+// do the two pure expressions compute the same thing
+bool sameExpression(Expression* a, Expression* b) {
+    a = sharedValue(a);
+    b = sharedValue(b);
+    if (a == b) {
+        return true;
+    }
+    if (a -> hash != b -> hash || a -> kind != b -> kind) {
+        return false;
+    }
+    switch (a -> kind) {
+        case EXPRESSION_LITERAL:
+            return a -> value == b -> value;
+
+        case EXPRESSION_VARIABLE:
+            return a -> symbol == b -> symbol && a -> scope == b -> scope && a -> slot == b -> slot;
+
+        case EXPRESSION_NOT:
+        case EXPRESSION_TRUTH:
+            return sameExpression(a -> left, b -> left);
+    }
+    return sameExpression(a -> left, b -> left) && sameExpression(a -> right, b -> right);
+}
+
+// replaces later copies of pure operators by reads of the first one, walking in evaluation order
+void shareExpression(Optimizer* optimizer, Expression* expression) {
+    bool candidate = expression -> pure && expression -> kind >= EXPRESSION_NOT;
+    if (candidate) {
+        for (uint64_t i = 0; i < optimizer -> numAvailable; i++) {
+            if (!sameExpression(optimizer -> available[i], expression)) {
+                continue;
+            }
+
+            Expression* share = optimizer -> shares[i];
+            if (share == NULL) {
+                // the first copy keeps computing the value, and now also stores it
+                Expression* first = optimizer -> available[i];
+                Expression* value = (Expression*) (arenaAlloc(optimizer -> arena, sizeof(Expression)));
+                *value = *first;
+                first -> kind = EXPRESSION_SHARE;
+                first -> left = value;
+                first -> right = NULL;
+                first -> slot = (uint32_t) (optimizer -> firstTemporary + optimizer -> numTemporaries++);
+                if (optimizer -> numTemporaries > optimizer -> maxTemporaries) {
+                    optimizer -> maxTemporaries = optimizer -> numTemporaries;
+                }
+                optimizer -> available[i] = value;
+                optimizer -> shares[i] = first;
+                share = first;
+            }
+
+            // a temporary is always assigned before it is read, so it is read like a parameter
+            expression -> kind = EXPRESSION_VARIABLE;
+            expression -> scope = SCOPE_PARAMETER;
+            expression -> slot = share -> slot;
+            expression -> left = share -> left;
+            expression -> right = NULL;
+            return;
+        }
+        if (optimizer -> numAvailable < OPTIMIZER_MAX_AVAILABLE) {
+            optimizer -> available[optimizer -> numAvailable] = expression;
+            optimizer -> shares[optimizer -> numAvailable++] = NULL;
+        }
+    }
+
+    for (uint64_t i = 0; i < expression -> numArguments; i++) {
+        shareExpression(optimizer, expression -> arguments[i]);
+    }
+    if (expression -> left != NULL && expression -> kind != EXPRESSION_VARIABLE) {
+        shareExpression(optimizer, expression -> left);
+    }
+    if (expression -> right != NULL) {
+        // the right operand of && and || may be skipped, so nothing computed in it can be reused after it
+        uint64_t numAvailable = optimizer -> numAvailable;
+        shareExpression(optimizer, expression -> right);
+        if ((expression -> kind == EXPRESSION_AND || expression -> kind == EXPRESSION_OR) &&
+                optimizer -> numAvailable > numAvailable) {
+            // (if it made a call, nothing from before it can be reused either)
+            optimizer -> numAvailable = expression -> right -> pure ? numAvailable : 0;
+        }
+    }
+
+    // the call may have changed any variable, so nothing before it can be reused after it
+    if (expression -> kind == EXPRESSION_CALL) {
+        optimizer -> numAvailable = 0;
+    }
+}
+
+// optimizes the expression of a statement
+Expression* optimizeExpression(Optimizer* optimizer, Expression* expression) {
+    expression = foldExpression(optimizer, expression);
+    if (optimizer -> function != NULL) {
+        optimizer -> numAvailable = 0;
+        optimizer -> numTemporaries = 0;
+        shareExpression(optimizer, expression);
+    }
+    markSkippable(optimizer, expression);
+    return expression;
+}
+
+// is the expression a plain read of the variable the statement assigns
+bool readsAssigned(Statement* statement, Expression* expression) {
+    return expression -> kind == EXPRESSION_VARIABLE && expression -> left == NULL &&
+        expression -> symbol == statement -> symbol && expression -> scope == statement -> scope &&
+        expression -> slot == statement -> slot;
+}
+
+bool isOperand(Expression* expression) {
+    return expression -> kind == EXPRESSION_LITERAL || expression -> kind == EXPRESSION_VARIABLE;
+}
+
+void noteCalls(Optimizer* optimizer, Expression* expression) {
+    if (expression == NULL || optimizer -> loopCalls) {
+        return;
+    }
+    if (expression -> kind == EXPRESSION_CALL) {
+        optimizer -> loopCalls = true;
+        return;
+    }
+    if (expression -> kind != EXPRESSION_VARIABLE) {
+        noteCalls(optimizer, expression -> left);
+    }
+    noteCalls(optimizer, expression -> right);
+}
+
+void noteWrites(Optimizer* optimizer, Block* block, uint64_t length) {
+    for (uint64_t i = 0; i < length; i++) {
+        Statement* s = block -> statements[i];
+        if (s -> kind == STATEMENT_ASSIGN && s -> scope == SCOPE_PARAMETER) {
+            optimizerAppend(&(optimizer -> writtenSlots), &(optimizer -> numWrittenSlots), &(optimizer -> writtenSlotCapacity), s -> slot);
+        }
+        else if (s -> kind == STATEMENT_ASSIGN) {
+            optimizerAppend(&(optimizer -> writtenSymbols), &(optimizer -> numWrittenSymbols), &(optimizer -> writtenSymbolCapacity), s -> symbol);
+        }
+        noteCalls(optimizer, s -> expression);
+        noteWrites(optimizer, &(s -> body), s -> body.length);
+        noteWrites(optimizer, &(s -> elseBody), s -> elseBody.length);
+    }
+}
+
+// finds what the first length statements of a loop body (and the condition) assign and whether they make calls
+void loopWrites(Optimizer* optimizer, Statement* loop, uint64_t length) {
+    optimizer -> numWrittenSymbols = 0;
+    optimizer -> numWrittenSlots = 0;
+    optimizer -> loopCalls = false;
+    noteCalls(optimizer, loop -> expression);
+    noteWrites(optimizer, &(loop -> body), length);
+}
+
+bool assignedInLoop(Optimizer* optimizer, Expression* variable) {
+    if (variable -> scope == SCOPE_PARAMETER) {
+        for (uint64_t i = 0; i < optimizer -> numWrittenSlots; i++) {
+            if (optimizer -> writtenSlots[i] == variable -> slot) {
+                return true;
+            }
+        }
+        return false;
+    }
+    for (uint64_t i = 0; i < optimizer -> numWrittenSymbols; i++) {
+        if (optimizer -> writtenSymbols[i] == variable -> symbol) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// while (i < n) { ...; i = i + k }, with nothing else in the loop assigning i or n
+bool isCountedLoop(Optimizer* optimizer, Statement* statement) {
+    Expression* condition = statement -> expression;
+    if (statement -> body.length == 0 || condition -> left -> kind != EXPRESSION_VARIABLE || condition -> left -> left != NULL) {
+        return false;
+    }
+    Statement* increment = statement -> body.statements[statement -> body.length - 1];
+    if (increment -> kind != STATEMENT_ASSIGN || increment -> shape != SHAPE_INCREMENT || !readsAssigned(increment, condition -> left)) {
+        return false;
+    }
+    loopWrites(optimizer, statement, statement -> body.length - 1);
+    if (assignedInLoop(optimizer, condition -> left)) {
+        return false;
+    }
+    // and n is not i
+    if (readsAssigned(increment, condition -> right)) {
+        return false;
+    }
+    statement -> loopCalls = optimizer -> loopCalls;
+    return condition -> right -> kind == EXPRESSION_LITERAL || !assignedInLoop(optimizer, condition -> right);
+}
+
+// marks the statement with the shape it has, if it is one the tree walker runs in one step
+void shapeStatement(Optimizer* optimizer, Statement* statement) {
+    Expression* e = statement -> expression;
+    statement -> shape = SHAPE_GENERIC;
+
+    if (statement -> kind == STATEMENT_ASSIGN && (e -> kind == EXPRESSION_ADD || e -> kind == EXPRESSION_SUBTRACT)) {
+        // x + ... or ... + x: the other side has no effects, so it does not matter which is evaluated first
+        Expression* other = NULL;
+        if (readsAssigned(statement, e -> left)) {
+            other = e -> right;
+        }
+        else if (e -> kind == EXPRESSION_ADD && readsAssigned(statement, e -> right)) {
+            other = e -> left;
+        }
+        if (other == NULL) {
+            return;
+        }
+        if (other -> kind == EXPRESSION_LITERAL) {
+            statement -> shape = SHAPE_INCREMENT;
+            statement -> step = (e -> kind == EXPRESSION_ADD) ? other -> value : 0 - other -> value;
+        }
+        else if (other -> pure && e -> kind == EXPRESSION_ADD) {
+            // without a call, evaluating the operand cannot change the variable or where it lives
+            statement -> shape = SHAPE_ACCUMULATE;
+            statement -> operand = other;
+        }
+    }
+    else if ((statement -> kind == STATEMENT_IF || statement -> kind == STATEMENT_WHILE) &&
+            e -> kind >= EXPRESSION_LESS && e -> kind <= EXPRESSION_NOT_EQUAL &&
+            isOperand(e -> left) && isOperand(e -> right)) {
+        bool counted = (statement -> kind == STATEMENT_WHILE && isCountedLoop(optimizer, statement));
+        statement -> shape = counted ? SHAPE_COUNTED : SHAPE_COMPARE;
+    }
+}
+
+void optimizeBlock(Optimizer* optimizer, Block* block);
+
+// optimizes a statement and the blocks in it, a dead branch is left empty
+void optimizeStatement(Optimizer* optimizer, Statement* statement) {
+    if (!optimizer -> enabled || statement -> expression == NULL) {
+        return;
+    }
+    statement -> expression = optimizeExpression(optimizer, statement -> expression);
+    optimizeBlock(optimizer, &(statement -> body));
+    optimizeBlock(optimizer, &(statement -> elseBody));
+    shapeStatement(optimizer, statement);
+
+    Expression* condition = statement -> expression;
+    if (condition -> kind != EXPRESSION_LITERAL) {
+        return;
+    }
+    if (statement -> kind == STATEMENT_IF) {
+        // only one branch can ever run
+        if (condition -> value != 0) {
+            statement -> elseBody.length = 0;
+        }
+        else {
+            statement -> body.length = 0;
+        }
+    }
+    else if (statement -> kind == STATEMENT_WHILE && condition -> value == 0) {
+        statement -> body.length = 0;
+    }
+}
+
+// optimizes the statements of a block, splicing in the branch of every if that is decided in advance
+void optimizeBlock(Optimizer* optimizer, Block* block) {
+    Block optimized = { NULL, 0, 0 };
+    for (uint64_t i = 0; i < block -> length; i++) {
+        Statement* s = block -> statements[i];
+        optimizeStatement(optimizer, s);
+
+        bool constant = (s -> expression != NULL && s -> expression -> kind == EXPRESSION_LITERAL);
+        if (constant && s -> kind == STATEMENT_IF) {
+            Block* taken = (s -> expression -> value != 0) ? &(s -> body) : &(s -> elseBody);
+            for (uint64_t j = 0; j < taken -> length; j++) {
+                blockAppend(optimizer -> arena, &optimized, taken -> statements[j]);
+            }
+        }
+        else if (!(constant && s -> kind == STATEMENT_WHILE && s -> expression -> value == 0)) {
+            blockAppend(optimizer -> arena, &optimized, s);
+        }
+
+        // nothing after a return runs
+        if (optimized.length > 0 && optimized.statements[optimized.length - 1] -> kind == STATEMENT_RETURN) {
+            break;
+        }
+    }
+
+    arenaFree(optimizer -> arena, block -> statements, sizeof(Statement*) * block -> capacity);
+    *block = optimized;
+}
+
+// can the loop being looked at change the value of the expression
+bool invariantInLoop(Optimizer* optimizer, Expression* expression) {
+    switch (expression -> kind) {
+        case EXPRESSION_LITERAL:
+            return true;
+
+        case EXPRESSION_VARIABLE:
+            if (expression -> left != NULL && expression -> slot < optimizer -> firstHoisted) {
+                // a temporary of common subexpression elimination only holds its value within one statement
+                return false;
+            }
+            if (expression -> scope != SCOPE_PARAMETER && optimizer -> loopCalls) {
+                // a call may assign any global, and a local that was never assigned reads its global
+                return false;
+            }
+            return !assignedInLoop(optimizer, expression);
+
+        case EXPRESSION_CALL:
+        case EXPRESSION_SHARE:
+            return false;
+    }
+    return invariantInLoop(optimizer, expression -> left) &&
+        (expression -> right == NULL || invariantInLoop(optimizer, expression -> right));
+}
+
+// computes the expression before the loop into a new frame slot, and reads the slot in its place
+void hoist(Optimizer* optimizer, Expression* expression, Block* preheader) {
+    Expression* value = (Expression*) (arenaAlloc(optimizer -> arena, sizeof(Expression)));
+    *value = *expression;
+
+    // the slot is always assigned before it is read, so it is read (and assigned) like a parameter
+    Statement* s = statementConstructor(optimizer -> arena, STATEMENT_ASSIGN, expression -> offset);
+    s -> scope = SCOPE_PARAMETER;
+    s -> slot = (uint32_t) (optimizer -> firstHoisted + optimizer -> numHoisted++);
+    s -> expression = value;
+    blockAppend(optimizer -> arena, preheader, s);
+
+    expression -> kind = EXPRESSION_VARIABLE;
+    expression -> scope = SCOPE_PARAMETER;
+    expression -> slot = s -> slot;
+    expression -> left = value;
+    expression -> right = NULL;
+}
+
+// hoists the largest loop-invariant operators in the expression
+void hoistExpression(Optimizer* optimizer, Expression* expression, Block* preheader) {
+    if (expression == NULL || expression -> kind == EXPRESSION_VARIABLE) {
+        return;
+    }
+    if (expression -> kind >= EXPRESSION_NOT && invariantInLoop(optimizer, expression)) {
+        hoist(optimizer, expression, preheader);
+        return;
+    }
+    for (uint64_t i = 0; i < expression -> numArguments; i++) {
+        hoistExpression(optimizer, expression -> arguments[i], preheader);
+    }
+    hoistExpression(optimizer, expression -> left, preheader);
+    hoistExpression(optimizer, expression -> right, preheader);
+}
+
+void hoistStatements(Optimizer* optimizer, Block* block, Block* preheader) {
+    for (uint64_t i = 0; i < block -> length; i++) {
+        Statement* s = block -> statements[i];
+        if (s -> expression != NULL) {
+            hoistExpression(optimizer, s -> expression, preheader);
+        }
+        hoistStatements(optimizer, &(s -> body), preheader);
+        hoistStatements(optimizer, &(s -> elseBody), preheader);
+    }
+}
+
+// what hoisting left in a loop may have a shape now (i < n * n became i < slot)
+void reshapeBlock(Optimizer* optimizer, Block* block) {
+    for (uint64_t i = 0; i < block -> length; i++) {
+        Statement* s = block -> statements[i];
+        reshapeBlock(optimizer, &(s -> body));
+        reshapeBlock(optimizer, &(s -> elseBody));
+        if (s -> expression != NULL) {
+            shapeStatement(optimizer, s);
+        }
+    }
+}
+
+// moves what the loops of a block do not change out of them, innermost loops first
+void hoistBlock(Optimizer* optimizer, Block* block) {
+    Block hoisted = { NULL, 0, 0 };
+    for (uint64_t i = 0; i < block -> length; i++) {
+        Statement* s = block -> statements[i];
+        hoistBlock(optimizer, &(s -> body));
+        hoistBlock(optimizer, &(s -> elseBody));
+
+        if (s -> kind == STATEMENT_WHILE) {
+            uint64_t before = optimizer -> numHoisted;
+            loopWrites(optimizer, s, s -> body.length);
+            hoistExpression(optimizer, s -> expression, &hoisted);
+            hoistStatements(optimizer, &(s -> body), &hoisted);
+            if (optimizer -> numHoisted > before) {
+                reshapeBlock(optimizer, &(s -> body));
+                shapeStatement(optimizer, s);
+            }
+        }
+        blockAppend(optimizer -> arena, &hoisted, s);
+    }
+
+    arenaFree(optimizer -> arena, block -> statements, sizeof(Statement*) * block -> capacity);
+    *block = hoisted;
+}
+
+// optimizes a parsed and resolved function body, adding its temporaries to the frame
+void optimizeFunction(Optimizer* optimizer, Function* function) {
+    if (!optimizer -> enabled) {
+        return;
+    }
+    optimizer -> function = function;
+    optimizer -> firstTemporary = function -> frameSize;
+    optimizer -> maxTemporaries = 0;
+    optimizeBlock(optimizer, &(function -> body));
+    function -> frameSize += optimizer -> maxTemporaries;
+
+    // values hoisted out of loops live as long as their loop, so they get slots of their own
+    optimizer -> firstHoisted = function -> frameSize;
+    optimizer -> numHoisted = 0;
+    hoistBlock(optimizer, &(function -> body));
+    function -> frameSize += optimizer -> numHoisted;
+    optimizer -> function = NULL;
+}
+
+// whether a while loop runs anywhere in the statement
+bool hasLoop(Statement* statement) {
+    if (statement -> kind == STATEMENT_WHILE) {
+        return true;
+    }
+    for (uint64_t i = 0; i < statement -> body.length; i++) {
+        if (hasLoop(statement -> body.statements[i])) {
+            return true;
+        }
+    }
+    for (uint64_t i = 0; i < statement -> elseBody.length; i++) {
+        if (hasLoop(statement -> elseBody.statements[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// optimizes a parsed and resolved top-level statement, if it has a loop
+void optimizeTopLevel(Optimizer* optimizer, Statement* statement) {
+    if (hasLoop(statement)) {
+        optimizeStatement(optimizer, statement);
+    }
+}
+
+void optimizerConstructor(Optimizer* optimizer, Arena* arena) {
+    memset(optimizer, 0, sizeof(Optimizer));
+    optimizer -> enabled = true;
+    optimizer -> arena = arena;
+}
+
+void freeOptimizer(Optimizer* optimizer) {
+    free(optimizer -> calls);
+    free(optimizer -> writtenSymbols);
+    free(optimizer -> writtenSlots);
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Everything a program prints goes through one buffer, which is handed to
+// write(2) when it fills up and when the interpreter is done. When stdout is a
+// terminal, each line is written as soon as it is complete instead, so output
+// shows up while the program runs. A captured output (--batch) collects
+// everything in memory instead of writing it anywhere.
+
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+// the fd of an output that is captured
+#define OUTPUT_CAPTURE (-1)
+
+typedef struct Output {
+    char* buffer;
+    uint64_t length;
+    int fd;
+    bool lineBuffered;                  // flush after every line (stdout is a terminal)
+    // what a captured output has flushed so far
+    char* captured;
+    uint64_t capturedLength;
+    uint64_t capturedCapacity;
+} Output;
+
+// "00" "01" ... "99", so numbers are converted two digits at a time
+static const char digitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// writes out everything in the buffer
+void outputFlush(Output* output) {
+    if (output -> fd == OUTPUT_CAPTURE) {
+        if (output -> length == 0) {
+            return;
+        }
+        if (output -> capturedLength + output -> length > output -> capturedCapacity) {
+            uint64_t capacity = (output -> capturedCapacity == 0) ? OUTPUT_BUFFER_SIZE : output -> capturedCapacity;
+            while (capacity < output -> capturedLength + output -> length) {
+                capacity *= 2;
+            }
+            output -> captured = (char*) (realloc(output -> captured, capacity));
+            output -> capturedCapacity = capacity;
+        }
+        memcpy(output -> captured + output -> capturedLength, output -> buffer, output -> length);
+        output -> capturedLength += output -> length;
+        output -> length = 0;
+        return;
+    }
+    char const* start = output -> buffer;
+    uint64_t remaining = output -> length;
+    while (remaining > 0) {
+        ssize_t written = write(output -> fd, start, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // nowhere to send it (e.g. a closed pipe), so drop it
+            break;
+        }
+        start += written;
+        remaining -= (uint64_t) written;
+    }
+    output -> length = 0;
+}
+
+void outputBytes(Output* output, char const* bytes, uint64_t length) {
+    if (output -> length + length > OUTPUT_BUFFER_SIZE) {
+        outputFlush(output);
+        if (length > OUTPUT_BUFFER_SIZE) {
+            // too big to buffer, write it straight through
+            char* buffer = output -> buffer;
+            output -> buffer = (char*) bytes;
+            output -> length = length;
+            outputFlush(output);
+            output -> buffer = buffer;
+            return;
+        }
+    }
+    memcpy(output -> buffer + output -> length, bytes, length);
+    output -> length += length;
+}
+
+void outputString(Output* output, char const* string) {
+    outputBytes(output, string, strlen(string));
+}
+
+// writes the value in decimal followed by a newline
+void outputLine(Output* output, uint64_t value) {
+    // 20 digits is enough for any uint64_t
+    char digits[21];
+    char* p = digits + sizeof(digits);
+    *(--p) = '\n';
+    while (value >= 100) {
+        uint64_t pair = (value % 100) * 2;
+        value /= 100;
+        *(--p) = digitPairs[pair + 1];
+        *(--p) = digitPairs[pair];
+    }
+    if (value >= 10) {
+        *(--p) = digitPairs[value * 2 + 1];
+        *(--p) = digitPairs[value * 2];
+    }
+    else {
+        *(--p) = (char) ('0' + value);
+    }
+
+    uint64_t length = (uint64_t) (digits + sizeof(digits) - p);
+    if (output -> length + length > OUTPUT_BUFFER_SIZE) {
+        outputFlush(output);
+    }
+    memcpy(output -> buffer + output -> length, p, length);
+    output -> length += length;
+    if (output -> lineBuffered) {
+        outputFlush(output);
+    }
+}
+
+void outputConstructor(Output* output, int fd) {
+    output -> buffer = (char*) (malloc(OUTPUT_BUFFER_SIZE));
+    output -> length = 0;
+    output -> fd = fd;
+    output -> lineBuffered = isatty(fd);
+    output -> captured = NULL;
+    output -> capturedLength = 0;
+    output -> capturedCapacity = 0;
+}
+
+// from now on, keeps what is printed in memory (output -> captured) instead of writing it
+void outputCapture(Output* output) {
+    outputFlush(output);
+    output -> fd = OUTPUT_CAPTURE;
+    output -> lineBuffered = false;
+}
+
+// writes out whatever is left and frees the buffer
+void freeOutput(Output* output) {
+    outputFlush(output);
+    free(output -> buffer);
+    free(output -> captured);
+}
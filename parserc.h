@@ -0,0 +1,649 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Implementation includes
+#include "lexerc.h"
+#include "cachec.h"
+#include "inputc.h"
+#include "astc.h"
+#include "outputc.h"
+
+// optional -> allows one to check if a slice/int was returned/exists
+#define optional(type) struct { bool exists; type item; }
+
+typedef optional(Slice) optionalSlice;
+typedef optional(uint64_t) optionalInt;
+
+typedef struct Parser {
+    char* program;
+    Lexer lexer;
+    Token* current;
+    // where the syntax tree of the top-level statement being parsed is allocated
+    Arena* arena;
+    // where what outlives its top-level statement is allocated: functions and their bodies
+    Arena* functionArena;
+    // where the program's output goes, failure messages come after whatever was printed
+    Output* output;
+    // when set, a failure jumps here (with the offset in failedOffset) instead of exiting
+    jmp_buf* recover;
+    uint64_t failedOffset;
+    // where the rest of the program comes from while it is still being lexed (or read, from a pipe), otherwise NULL
+    Input* input;
+    // the program, when it is all in memory but lexed a piece at a time
+    Input text;
+    // the program's length, when the tokens came from a cache file (see checkedOffset)
+    uint64_t length;
+} Parser;
+
+// a token's offset into the program. Only a damaged cache file (cachec.h) can have one past its end,
+// which then stands for the end
+uint64_t checkedOffset(Parser* parser, uint64_t offset) {
+    if (parser -> lexer.mapping != NULL && offset > parser -> length) {
+        return parser -> length;
+    }
+    return offset;
+}
+
+// prints where the program failed and the rest of the program after it
+void failureMessage(Parser* parser, uint64_t offset) {
+    // the message shows the rest of the program, all of it
+    if (parser -> input != NULL) {
+        outputFlush(parser -> output);
+        inputReadAll(parser -> input);
+    }
+    offset = checkedOffset(parser, offset);
+    outputString(parser -> output, "failed at offset ");
+    outputLine(parser -> output, offset);
+    outputString(parser -> output, parser -> program + offset);
+    outputString(parser -> output, "\n");
+}
+
+void failAt(Parser* parser, uint64_t offset) {
+    if (parser -> recover != NULL) {
+        parser -> failedOffset = offset;
+        longjmp(*(parser -> recover), 1);
+    }
+    failureMessage(parser, offset);
+    outputFlush(parser -> output);
+    exit(1);
+}
+
+void fail(Parser* parser) {
+    failAt(parser, parser -> current -> offset);
+}
+
+// fails just after the keyword, where the original interpreter found that it does not belong there
+void failAfter(Parser* parser, Token* keyword) {
+    uint64_t offset = checkedOffset(parser, keyword -> offset);
+    while (isalnum(parser -> program[offset])) {
+        offset++;
+    }
+    failAt(parser, offset);
+}
+
+// where a call to a function that does not exist fails: at the ( of a call statement, or just after the ( of
+// a call in an expression, as the original interpreter did
+uint64_t missingFunctionOffset(Parser* parser, Expression* call) {
+    uint64_t offset = checkedOffset(parser, call -> offset);
+    while (isalnum(parser -> program[offset])) {
+        offset++;
+    }
+    while (isspace(parser -> program[offset])) {
+        offset++;
+    }
+    return (call -> position == CALL_STATEMENT) ? offset : offset + 1;
+}
+
+void endOrFail(Parser* parser) {
+    if (parser -> current -> kind != TOKEN_END) {
+        fail(parser);
+    }
+}
+
+// consumes the current token if it is of the given kind
+bool consume(Parser* parser, uint32_t kind) {
+    if (parser -> current -> kind == kind) {
+        parser -> current++;
+        return true;
+    }
+    return false;
+}
+
+void consumeOrFail(Parser* parser, uint32_t kind) {
+    if (!consume(parser, kind)) {
+        fail(parser);
+    }
+}
+
+// consume a variable, giving back its interned id
+optionalInt consumeIdentifier(Parser* parser) {
+    // (an id that was never given out can only come from a damaged cache file)
+    if (parser -> current -> kind == TOKEN_IDENTIFIER && parser -> current -> value < parser -> lexer.numSymbols) {
+        optionalInt symbol = { true, parser -> current -> value };
+        parser -> current++;
+        return symbol;
+    }
+    else {
+        optionalInt symbol = { false, 0 };
+        return symbol;
+    }
+}
+
+// the name an interned id stands for
+Slice symbolName(Parser* parser, uint64_t symbol) {
+    return parser -> lexer.symbols[symbol];
+}
+
+// consume a number
+optionalInt consumeLiteral(Parser* parser) {
+    if (parser -> current -> kind == TOKEN_LITERAL) {
+        optionalInt opInt = { true, parser -> current -> value };
+        parser -> current++;
+        return opInt;
+    }
+    else {
+        optionalInt opInt = { false, 0 };
+        return opInt;
+    }
+}
+
+Expression* binaryExpression(Parser* parser, uint32_t kind, Expression* left, Expression* right) {
+    Expression* expression = expressionConstructor(parser -> arena, kind, left -> offset);
+    expression -> left = left;
+    expression -> right = right;
+    return expression;
+}
+
+// The plan is to honor as many C operators as possible with
+// the same precedence and associativity
+// e<n> implements operators with precedence 'n' (smaller is higher)
+
+Expression* expression(Parser* parser);
+
+// reads the arguments of a call up to and including the closing )
+void arguments(Parser* parser, Expression* call) {
+    uint64_t capacity = 0;
+    while (!consume(parser, TOKEN_RIGHT_PAREN)) {
+        if (call -> numArguments == capacity) {
+            uint64_t updatedCapacity = (capacity == 0) ? 4 : capacity * 2;
+            call -> arguments = (Expression**) (arenaRealloc(parser -> arena, call -> arguments,
+                sizeof(Expression*) * capacity, sizeof(Expression*) * updatedCapacity));
+            capacity = updatedCapacity;
+        }
+        call -> arguments[call -> numArguments++] = expression(parser);
+        consume(parser, TOKEN_COMMA);
+    }
+    call -> end = parser -> current[-1].offset + 1;
+}
+
+// () [] . -> ...
+Expression* e1(Parser* parser) {
+    uint32_t offset = parser -> current -> offset;
+
+    optionalInt id = consumeIdentifier(parser);
+    if (id.exists) {
+        if (consume(parser, TOKEN_LEFT_PAREN)) {
+            // function call
+            Expression* call = expressionConstructor(parser -> arena, EXPRESSION_CALL, offset);
+            call -> symbol = id.item;
+            arguments(parser, call);
+            return call;
+        }
+        Expression* variable = expressionConstructor(parser -> arena, EXPRESSION_VARIABLE, offset);
+        variable -> symbol = id.item;
+        return variable;
+    }
+
+    optionalInt val = consumeLiteral(parser);
+    if (val.exists) {
+        Expression* literal = expressionConstructor(parser -> arena, EXPRESSION_LITERAL, offset);
+        literal -> value = val.item;
+        return literal;
+    }
+
+    if (consume(parser, TOKEN_LEFT_PAREN)) {
+        Expression* v = expression(parser);
+        consume(parser, TOKEN_RIGHT_PAREN);
+        return v;
+    }
+
+    fail(parser);
+    return NULL;
+}
+
+// ++ -- unary+ unary- ... (Right)
+Expression* e2(Parser* parser) {
+    uint32_t offset = parser -> current -> offset;
+    bool neg = false;
+    bool encounteredNeg = false;
+
+    // logical not
+    while (consume(parser, TOKEN_NOT)) {
+        encounteredNeg = true;
+        neg = !neg;
+    }
+
+    Expression* v = e1(parser);
+    if (encounteredNeg) {
+        Expression* unary = expressionConstructor(parser -> arena, neg ? EXPRESSION_NOT : EXPRESSION_TRUTH, offset);
+        unary -> left = v;
+        return unary;
+    }
+    return v;
+}
+
+// * / % (Left)
+Expression* e3(Parser* parser) {
+    Expression* v = e2(parser);
+
+    while (true) {
+        if (consume(parser, TOKEN_STAR)) {
+            v = binaryExpression(parser, EXPRESSION_MULTIPLY, v, e2(parser));
+        }
+        else if (consume(parser, TOKEN_SLASH)) {
+            v = binaryExpression(parser, EXPRESSION_DIVIDE, v, e2(parser));
+        }
+        else if (consume(parser, TOKEN_PERCENT)) {
+            v = binaryExpression(parser, EXPRESSION_MODULO, v, e2(parser));
+        }
+        else {
+            return v;
+        }
+    }
+}
+
+// (Left) + -
+Expression* e4(Parser* parser) {
+    Expression* v = e3(parser);
+
+    while (true) {
+        if (consume(parser, TOKEN_PLUS)) {
+            v = binaryExpression(parser, EXPRESSION_ADD, v, e3(parser));
+        }
+        else if (consume(parser, TOKEN_MINUS)) {
+            v = binaryExpression(parser, EXPRESSION_SUBTRACT, v, e3(parser));
+        }
+        else {
+            return v;
+        }
+    }
+}
+
+// << >>
+Expression* e5(Parser* parser) {
+    return e4(parser);
+}
+
+// < <= > >=
+Expression* e6(Parser* parser) {
+    Expression* v = e5(parser);
+
+    while (true) {
+        if (consume(parser, TOKEN_LESS_EQUAL)) {
+            v = binaryExpression(parser, EXPRESSION_LESS_EQUAL, v, e5(parser));
+        }
+        else if (consume(parser, TOKEN_GREATER_EQUAL)) {
+            v = binaryExpression(parser, EXPRESSION_GREATER_EQUAL, v, e5(parser));
+        }
+        else if (consume(parser, TOKEN_LESS)) {
+            v = binaryExpression(parser, EXPRESSION_LESS, v, e5(parser));
+        }
+        else if (consume(parser, TOKEN_GREATER)) {
+            v = binaryExpression(parser, EXPRESSION_GREATER, v, e5(parser));
+        }
+        else {
+            return v;
+        }
+    }
+}
+
+// == !=
+Expression* e7(Parser* parser) {
+    Expression* v = e6(parser);
+
+    while (true) {
+        if (consume(parser, TOKEN_EQUAL)) {
+            v = binaryExpression(parser, EXPRESSION_EQUAL, v, e6(parser));
+        }
+        else if (consume(parser, TOKEN_NOT_EQUAL)) {
+            v = binaryExpression(parser, EXPRESSION_NOT_EQUAL, v, e6(parser));
+        }
+        else {
+            return v;
+        }
+    }
+}
+
+// (left) &
+Expression* e8(Parser* parser) {
+    return e7(parser);
+}
+
+// ^
+Expression* e9(Parser* parser) {
+    return e8(parser);
+}
+
+// |
+Expression* e10(Parser* parser) {
+    return e9(parser);
+}
+
+// &&
+Expression* e11(Parser* parser) {
+    Expression* v = e10(parser);
+
+    while (consume(parser, TOKEN_AND)) {
+        v = binaryExpression(parser, EXPRESSION_AND, v, e10(parser));
+    }
+    return v;
+}
+
+// ||
+Expression* e12(Parser* parser) {
+    Expression* v = e11(parser);
+
+    while (consume(parser, TOKEN_OR)) {
+        v = binaryExpression(parser, EXPRESSION_OR, v, e11(parser));
+    }
+    return v;
+}
+
+// (right with special treatment for middle expression) ?:
+Expression* e13(Parser* parser) {
+    return e12(parser);
+}
+
+// = += -= ...
+Expression* e14(Parser* parser) {
+    return e13(parser);
+}
+
+// ,
+Expression* e15(Parser* parser) {
+    return e14(parser);
+}
+
+Expression* expression(Parser* parser) {
+    return e15(parser);
+}
+
+Statement* statement(Parser* parser, bool insideFunction);
+
+// skips the comments where a statement could start, the only place they are allowed
+void skipComments(Parser* parser) {
+    while (parser -> current -> kind == TOKEN_COMMENT) {
+        parser -> current++;
+    }
+}
+
+// reads the statements of a block up to and including the closing }
+void block(Parser* parser, Block* body, bool insideFunction) {
+    while (true) {
+        skipComments(parser);
+        if (consume(parser, TOKEN_RIGHT_BRACE)) {
+            return;
+        }
+        Statement* s = statement(parser, insideFunction);
+        if (s == NULL) {
+            fail(parser);
+        }
+        blockAppend(parser -> arena, body, s);
+    }
+}
+
+// parses one statement, or returns NULL if there is no statement here
+Statement* statement(Parser* parser, bool insideFunction) {
+    skipComments(parser);
+    uint32_t offset = parser -> current -> offset;
+
+    if (insideFunction && consume(parser, TOKEN_RETURN)) {
+        Statement* s = statementConstructor(parser -> arena, STATEMENT_RETURN, offset);
+        s -> expression = expression(parser);
+        return s;
+    }
+
+    if (consume(parser, TOKEN_IF)) {
+        // if ...
+        Statement* s = statementConstructor(parser -> arena, STATEMENT_IF, offset);
+        consumeOrFail(parser, TOKEN_LEFT_PAREN);
+        s -> expression = expression(parser);
+        consumeOrFail(parser, TOKEN_RIGHT_PAREN);
+
+        consumeOrFail(parser, TOKEN_LEFT_BRACE);
+        block(parser, &(s -> body), insideFunction);
+
+        // check if there is an else statement
+        if (consume(parser, TOKEN_ELSE)) {
+            consumeOrFail(parser, TOKEN_LEFT_BRACE);
+            block(parser, &(s -> elseBody), insideFunction);
+        }
+        return s;
+    }
+
+    if (consume(parser, TOKEN_WHILE)) {
+        // while ...
+        Statement* s = statementConstructor(parser -> arena, STATEMENT_WHILE, offset);
+        consumeOrFail(parser, TOKEN_LEFT_PAREN);
+        s -> expression = expression(parser);
+        consumeOrFail(parser, TOKEN_RIGHT_PAREN);
+
+        consumeOrFail(parser, TOKEN_LEFT_BRACE);
+        block(parser, &(s -> body), insideFunction);
+        return s;
+    }
+
+    if (parser -> current -> kind == TOKEN_ELSE) {
+        // error, cannot have else without a preceding if statement
+        failAfter(parser, parser -> current);
+    }
+
+    if (consume(parser, TOKEN_FUN)) {
+        if (insideFunction) {
+            // cannot define a function inside another function
+            failAfter(parser, parser -> current - 1);
+        }
+
+        // fun ...
+        Statement* s = statementConstructor(parser -> arena, STATEMENT_FUN, offset);
+        Function* currentFunction = (Function*) (arenaCalloc(parser -> functionArena, sizeof(Function)));
+        currentFunction -> offset = offset;
+        s -> function = currentFunction;
+
+        optionalInt functionName = consumeIdentifier(parser);
+        if (functionName.exists) {
+            currentFunction -> name = symbolName(parser, functionName.item);
+            currentFunction -> symbol = functionName.item;
+        }
+        else {
+            fail(parser);
+        }
+
+        consume(parser, TOKEN_LEFT_PAREN);
+
+        // consume parameters
+        uint64_t capacity = 0;
+        while (!consume(parser, TOKEN_RIGHT_PAREN)) {
+            optionalInt parameterName = consumeIdentifier(parser);
+            if (!parameterName.exists) {
+                fail(parser);
+            }
+            if (currentFunction -> numParams == capacity) {
+                uint64_t updatedCapacity = (capacity == 0) ? 4 : capacity * 2;
+                currentFunction -> parameters = (uint64_t*) (arenaRealloc(parser -> functionArena, currentFunction -> parameters,
+                    sizeof(uint64_t) * capacity, sizeof(uint64_t) * updatedCapacity));
+                capacity = updatedCapacity;
+            }
+            currentFunction -> parameters[currentFunction -> numParams++] = parameterName.item;
+            consume(parser, TOKEN_COMMA);
+        }
+
+        // skip straight past the body, it is parsed by functionBody on the first call. Its tokens
+        // are kept with the function, the ones around them go once the statements have run
+        consumeOrFail(parser, TOKEN_LEFT_BRACE);
+        uint64_t closeIndex = parser -> current[-1].value;
+        // (a } out of place can only come from a damaged cache file)
+        if (closeIndex < (uint64_t) (parser -> current - parser -> lexer.tokens) ||
+                closeIndex >= parser -> lexer.numTokens) {
+            fail(parser);
+        }
+        Token* close = parser -> lexer.tokens + closeIndex;
+        if (close -> kind != TOKEN_RIGHT_BRACE) {
+            parser -> current = close;
+            fail(parser);
+        }
+        uint64_t length = close + 1 - parser -> current;
+        currentFunction -> tokens = (Token*) (arenaAlloc(parser -> functionArena, sizeof(Token) * (length + 1)));
+        memcpy(currentFunction -> tokens, parser -> current, sizeof(Token) * length);
+        Token* end = &(currentFunction -> tokens[length]);
+        end -> kind = TOKEN_END;
+        end -> offset = close -> offset;
+        end -> value = 0;
+        parser -> current = close + 1;
+
+        return s;
+    }
+
+    // check for invalid variable names (a return outside of a function lands here too)
+    if (parser -> current -> kind == TOKEN_RETURN) {
+        failAfter(parser, parser -> current);
+    }
+
+    optionalInt id = consumeIdentifier(parser);
+
+    if (!id.exists) {
+        return NULL;
+    }
+
+    if (consume(parser, TOKEN_ASSIGN)) {
+        Statement* s = statementConstructor(parser -> arena, STATEMENT_ASSIGN, offset);
+        s -> symbol = id.item;
+        s -> expression = expression(parser);
+        return s;
+    }
+
+    // can have a stand-alone function call without doing (var) = (function call)
+    if (consume(parser, TOKEN_LEFT_PAREN)) {
+        Statement* s = statementConstructor(parser -> arena, STATEMENT_CALL, offset);
+        Expression* call = expressionConstructor(parser -> arena, EXPRESSION_CALL, offset);
+        call -> symbol = id.item;
+        call -> position = CALL_STATEMENT;
+        arguments(parser, call);
+        s -> expression = call;
+        return s;
+    }
+
+    fail(parser);
+    return NULL;
+}
+
+// parses the body of a function that was skipped at its declaration, leaving the parser where it was
+void functionBody(Parser* parser, Function* function) {
+    Token* resume = parser -> current;
+    Arena* arena = parser -> arena;
+    parser -> current = function -> tokens;
+    parser -> arena = parser -> functionArena;
+    block(parser, &(function -> body), true);
+    parser -> current = resume;
+    parser -> arena = arena;
+}
+
+// lexes the next lines of the input that are complete (see inputLexable), keeping the parser on the same token
+void parserLexInput(Parser* parser) {
+    Input* input = parser -> input;
+    uint64_t end = inputLexable(input);
+    if (input -> lexedAll || (end == input -> lexed && !input -> ended)) {
+        return;
+    }
+    uint64_t current = parser -> current - parser -> lexer.tokens;
+    bool final = input -> ended && end == input -> length;
+    input -> lexedAll = lexMore(&(parser -> lexer), input -> buffer, input -> lexed, end, final);
+    input -> lexed = end;
+    parser -> current = parser -> lexer.tokens + current;
+}
+
+// the next top-level statement of a program that is still being lexed (or read). Lexes until the statement is
+// complete: it parses, and either a token after it has been lexed or nothing could be added to it (a call, a
+// loop or a declaration). The tokens of the statements before it are dropped first
+Statement* streamStatement(Parser* parser) {
+    Input* input = parser -> input;
+    uint64_t start = parser -> current - parser -> lexer.tokens;
+    while (!input -> lexedAll) {
+        // (a statement cannot end inside a block)
+        if (parser -> lexer.numOpen == 0 && parser -> current -> kind != TOKEN_END) {
+            jmp_buf recover;
+            jmp_buf* outer = parser -> recover;
+            parser -> recover = &recover;
+            Statement* s = NULL;
+            bool failed = setjmp(recover) != 0;
+            if (!failed) {
+                s = statement(parser, false);
+            }
+            parser -> recover = outer;
+            bool atEnd = parser -> current -> kind == TOKEN_END;
+            if (!failed && s != NULL && (!atEnd || s -> kind == STATEMENT_CALL || s -> kind == STATEMENT_WHILE ||
+                    s -> kind == STATEMENT_FUN)) {
+                return s;
+            }
+            parser -> current = parser -> lexer.tokens + start;
+            if (!atEnd) {
+                // more of the program cannot fix it
+                break;
+            }
+        }
+        lexerDrop(&(parser -> lexer), start);
+        parser -> current -= start;
+        start = 0;
+        // the read waits for whatever feeds the pipe, which may be waiting for what was printed so far
+        if (!input -> ended) {
+            outputFlush(parser -> output);
+        }
+        inputRead(input);
+        parserLexInput(parser);
+    }
+    return statement(parser, false);
+}
+
+// arena: where functions live, statementArena: where each top-level statement is parsed (the caller resets it
+// between statements). cacheDirectory: where the tokens of earlier runs are kept (--cache), or NULL, and
+// source: what the program was read from (for the cache), or NULL
+void parserConstructor(Parser* parser, char* prog, Arena* arena, Arena* statementArena, Output* output,
+        char const* cacheDirectory, struct stat const* source) {
+    parser -> program = prog;
+    parser -> arena = statementArena;
+    parser -> functionArena = arena;
+    parser -> output = output;
+    parser -> recover = NULL;
+    uint64_t length = strlen(prog);
+    lexerInit(&(parser -> lexer), arena);
+    if (cacheDirectory == NULL) {
+        // the tokens are made a piece at a time, as the statements need them (see streamStatement)
+        inputText(&(parser -> text), prog, length);
+        parser -> input = &(parser -> text);
+        lexFrom(&(parser -> lexer), prog, 0, 0, false);
+    }
+    else {
+        // all the tokens at once, so they can be kept for the next run
+        parser -> input = NULL;
+        parser -> length = length;
+        CacheKey key;
+        cacheKeyConstructor(&key, source, prog, length);
+        if (!cacheLoad(&(parser -> lexer), cacheDirectory, &key, prog, length)) {
+            lex(&(parser -> lexer), prog);
+            cacheStore(&(parser -> lexer), cacheDirectory, &key, prog, length);
+        }
+    }
+    parser -> current = parser -> lexer.tokens;
+}
@@ -0,0 +1,336 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+// Implementation includes
+#include "astc.h"
+
+// --profile: the evaluator reports, for every function and every source line,
+// how many calls and statements ran there and how much wall time they took.
+//
+//      * inclusive time runs from the start of a call (or statement) to its
+//        end, counting only the outermost one while it recurses
+//      * exclusive time is the part of it spent in no other call or statement:
+//        every time control moves between statements, calls and returns, the
+//        time since the last move goes to the line and the function running
+//
+// The time also goes to the chain of calls that led there (a calling context
+// tree), which --profile-stacks writes out as folded stacks for flamegraph
+// tools:   main;f;g 1234   (microseconds)
+//
+// When profiling is off, the evaluator only checks enabled once per statement
+// and once per call.
+
+// the functions table has one more entry for the top level
+#define PROFILE_TOP_LEVEL UINT64_MAX
+
+typedef struct ProfileEntry {
+    uint64_t calls;
+    uint64_t statements;
+    uint64_t inclusive;                 // nanoseconds
+    uint64_t exclusive;
+    uint64_t active;                    // calls (or statements) of it running right now
+    uint64_t start;                     // when the outermost of those started
+} ProfileEntry;
+
+// a chain of calls: the function, the chain it was called from, and the chains it called
+typedef struct ProfileNode {
+    uint64_t symbol;
+    uint64_t parent;
+    uint64_t firstChild;                // 0 if none, the root is never anyone's child
+    uint64_t nextSibling;
+    uint64_t time;                      // exclusive nanoseconds
+} ProfileNode;
+
+typedef struct Profiler {
+    bool enabled;
+    char const* program;
+
+    // where every line starts, lines are numbered from 1
+    uint64_t* lineStarts;
+    uint64_t numLines;
+    ProfileEntry* lines;
+
+    // by the interned id of the function's name
+    ProfileEntry* functions;
+    uint64_t functionCapacity;
+    ProfileEntry topLevel;
+
+    ProfileNode* nodes;
+    uint64_t numNodes;
+    uint64_t nodeCapacity;
+
+    // what is running now, and when the time up to now was last handed out
+    uint64_t line;
+    uint64_t node;
+    uint64_t last;
+} Profiler;
+
+uint64_t profileNow() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+ProfileEntry* profileFunction(Profiler* profiler, uint64_t symbol) {
+    if (symbol == PROFILE_TOP_LEVEL) {
+        return &(profiler -> topLevel);
+    }
+    if (symbol >= profiler -> functionCapacity) {
+        uint64_t capacity = (profiler -> functionCapacity == 0) ? 64 : profiler -> functionCapacity;
+        while (capacity <= symbol) {
+            capacity *= 2;
+        }
+        profiler -> functions = (ProfileEntry*) (realloc(profiler -> functions, sizeof(ProfileEntry) * capacity));
+        memset(profiler -> functions + profiler -> functionCapacity, 0, sizeof(ProfileEntry) * (capacity - profiler -> functionCapacity));
+        profiler -> functionCapacity = capacity;
+    }
+    return &(profiler -> functions[symbol]);
+}
+
+// the line the given program offset is on
+uint64_t profileLine(Profiler* profiler, uint64_t offset) {
+    uint64_t low = 1;
+    uint64_t high = profiler -> numLines;
+    while (low < high) {
+        uint64_t middle = (low + high + 1) / 2;
+        if (profiler -> lineStarts[middle] <= offset) {
+            low = middle;
+        }
+        else {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+// hands the time since the last move to whatever was running
+void profileTick(Profiler* profiler, uint64_t now) {
+    uint64_t elapsed = now - profiler -> last;
+    profiler -> last = now;
+    profiler -> lines[profiler -> line].exclusive += elapsed;
+    profileFunction(profiler, profiler -> nodes[profiler -> node].symbol) -> exclusive += elapsed;
+    profiler -> nodes[profiler -> node].time += elapsed;
+}
+
+void profileStart(ProfileEntry* entry, uint64_t now) {
+    if (entry -> active++ == 0) {
+        entry -> start = now;
+    }
+}
+
+void profileStop(ProfileEntry* entry, uint64_t now) {
+    if (--(entry -> active) == 0) {
+        entry -> inclusive += now - entry -> start;
+    }
+}
+
+// a call of the function with the given name starts
+void profileEnter(Profiler* profiler, uint64_t symbol) {
+    uint64_t now = profileNow();
+    profileTick(profiler, now);
+
+    // the chain for this call, made the first time it happens
+    uint64_t child = profiler -> nodes[profiler -> node].firstChild;
+    while (child != 0 && profiler -> nodes[child].symbol != symbol) {
+        child = profiler -> nodes[child].nextSibling;
+    }
+    if (child == 0) {
+        if (profiler -> numNodes == profiler -> nodeCapacity) {
+            profiler -> nodeCapacity *= 2;
+            profiler -> nodes = (ProfileNode*) (realloc(profiler -> nodes, sizeof(ProfileNode) * profiler -> nodeCapacity));
+        }
+        child = profiler -> numNodes++;
+        ProfileNode* node = &(profiler -> nodes[child]);
+        node -> symbol = symbol;
+        node -> parent = profiler -> node;
+        node -> firstChild = 0;
+        node -> nextSibling = profiler -> nodes[profiler -> node].firstChild;
+        node -> time = 0;
+        profiler -> nodes[profiler -> node].firstChild = child;
+    }
+    profiler -> node = child;
+
+    ProfileEntry* entry = profileFunction(profiler, symbol);
+    entry -> calls++;
+    profileStart(entry, now);
+}
+
+// the running call returns
+void profileLeave(Profiler* profiler) {
+    uint64_t now = profileNow();
+    profileTick(profiler, now);
+    profileStop(profileFunction(profiler, profiler -> nodes[profiler -> node].symbol), now);
+    profiler -> node = profiler -> nodes[profiler -> node].parent;
+}
+
+// a statement starts, returns the line that was running before it
+uint64_t profileStatementStart(Profiler* profiler, Statement* statement) {
+    uint64_t now = profileNow();
+    profileTick(profiler, now);
+    uint64_t previous = profiler -> line;
+    profiler -> line = profileLine(profiler, statement -> offset);
+
+    ProfileEntry* line = &(profiler -> lines[profiler -> line]);
+    line -> statements++;
+    profileStart(line, now);
+    profileFunction(profiler, profiler -> nodes[profiler -> node].symbol) -> statements++;
+    return previous;
+}
+
+void profileStatementEnd(Profiler* profiler, uint64_t previous) {
+    uint64_t now = profileNow();
+    profileTick(profiler, now);
+    profileStop(&(profiler -> lines[profiler -> line]), now);
+    profiler -> line = previous;
+}
+
+// starts profiling a run of the given program
+void profileEnable(Profiler* profiler) {
+    char const* program = profiler -> program;
+    uint64_t capacity = 64;
+    profiler -> lineStarts = (uint64_t*) (malloc(sizeof(uint64_t) * capacity));
+    // line 0 is where time goes before the first statement
+    profiler -> lineStarts[0] = 0;
+    profiler -> lineStarts[1] = 0;
+    profiler -> numLines = 1;
+    for (uint64_t i = 0; program[i] != 0; i++) {
+        if (program[i] == '\n' && program[i + 1] != 0) {
+            if (profiler -> numLines + 1 == capacity) {
+                capacity *= 2;
+                profiler -> lineStarts = (uint64_t*) (realloc(profiler -> lineStarts, sizeof(uint64_t) * capacity));
+            }
+            profiler -> lineStarts[++(profiler -> numLines)] = i + 1;
+        }
+    }
+    profiler -> lines = (ProfileEntry*) (calloc(profiler -> numLines + 1, sizeof(ProfileEntry)));
+
+    profiler -> nodeCapacity = 64;
+    profiler -> nodes = (ProfileNode*) (calloc(profiler -> nodeCapacity, sizeof(ProfileNode)));
+    profiler -> nodes[0].symbol = PROFILE_TOP_LEVEL;
+    profiler -> numNodes = 1;
+    profiler -> node = 0;
+    profiler -> line = 0;
+    profiler -> last = profileNow();
+    profiler -> topLevel.calls = 1;
+    profileStart(&(profiler -> topLevel), profiler -> last);
+    profiler -> enabled = true;
+}
+
+char const* profileName(Slice* symbols, uint64_t symbol) {
+    return (symbol == PROFILE_TOP_LEVEL) ? "main" : symbols[symbol].start;
+}
+
+int profileNameLength(Slice* symbols, uint64_t symbol) {
+    return (symbol == PROFILE_TOP_LEVEL) ? 4 : (int) symbols[symbol].len;
+}
+
+// an entry to sort by exclusive time, most first
+typedef struct ProfileRank {
+    uint64_t exclusive;
+    uint64_t index;
+} ProfileRank;
+
+int profileCompare(const void* a, const void* b) {
+    uint64_t x = ((const ProfileRank*) a) -> exclusive;
+    uint64_t y = ((const ProfileRank*) b) -> exclusive;
+    return (x < y) ? 1 : (x > y) ? -1 : 0;
+}
+
+// the indexes of the entries that ran at all, sorted
+uint64_t profileRank(ProfileEntry* entries, uint64_t first, uint64_t end, ProfileRank* order) {
+    uint64_t n = 0;
+    for (uint64_t i = first; i < end; i++) {
+        if (entries[i].calls > 0 || entries[i].statements > 0) {
+            order[n].exclusive = entries[i].exclusive;
+            order[n++].index = i;
+        }
+    }
+    qsort(order, n, sizeof(ProfileRank), profileCompare);
+    return n;
+}
+
+void profilePrintFunction(FILE* out, ProfileEntry* entry, char const* name, int length) {
+    fprintf(out, "%-24.*s %12lu %14lu %14.3f %14.3f\n", length, name, entry -> calls, entry -> statements,
+        entry -> inclusive / 1e6, entry -> exclusive / 1e6);
+}
+
+// writes the functions, then the lines, each sorted by exclusive time
+void profileReport(Profiler* profiler, FILE* out, Slice* symbols) {
+    uint64_t now = profileNow();
+    profileTick(profiler, now);
+    profileStop(&(profiler -> topLevel), now);
+
+    uint64_t count = (profiler -> functionCapacity > profiler -> numLines + 1) ? profiler -> functionCapacity : profiler -> numLines + 1;
+    ProfileRank* order = (ProfileRank*) (malloc(sizeof(ProfileRank) * count));
+
+    fprintf(out, "%-24s %12s %14s %14s %14s\n", "function", "calls", "statements", "inclusive ms", "exclusive ms");
+    profilePrintFunction(out, &(profiler -> topLevel), "main", 4);
+    uint64_t n = profileRank(profiler -> functions, 0, profiler -> functionCapacity, order);
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t symbol = order[i].index;
+        profilePrintFunction(out, &(profiler -> functions[symbol]), symbols[symbol].start, (int) symbols[symbol].len);
+    }
+
+    fprintf(out, "\n%-8s %14s %14s %14s  %s\n", "line", "statements", "inclusive ms", "exclusive ms", "source");
+    n = profileRank(profiler -> lines, 1, profiler -> numLines + 1, order);
+    for (uint64_t i = 0; i < n; i++) {
+        ProfileEntry* line = &(profiler -> lines[order[i].index]);
+        char const* source = profiler -> program + profiler -> lineStarts[order[i].index];
+        while (*source == ' ' || *source == '\t') {
+            source++;
+        }
+        int length = 0;
+        while (length < 40 && source[length] != 0 && source[length] != '\n' && source[length] != '\r') {
+            length++;
+        }
+        fprintf(out, "%-8lu %14lu %14.3f %14.3f  %.*s\n", order[i].index, line -> statements,
+            line -> inclusive / 1e6, line -> exclusive / 1e6, length, source);
+    }
+    free(order);
+}
+
+// one line per chain of calls that took any time: the names from the top level down, and the microseconds
+void profileWriteStacks(Profiler* profiler, FILE* out, Slice* symbols) {
+    uint64_t* path = (uint64_t*) (malloc(sizeof(uint64_t) * profiler -> numNodes));
+    for (uint64_t i = 0; i < profiler -> numNodes; i++) {
+        uint64_t micros = profiler -> nodes[i].time / 1000;
+        if (micros == 0) {
+            continue;
+        }
+        uint64_t depth = 0;
+        for (uint64_t node = i; node != 0; node = profiler -> nodes[node].parent) {
+            path[depth++] = node;
+        }
+        fprintf(out, "main");
+        while (depth > 0) {
+            uint64_t symbol = profiler -> nodes[path[--depth]].symbol;
+            fprintf(out, ";%.*s", profileNameLength(symbols, symbol), profileName(symbols, symbol));
+        }
+        fprintf(out, " %lu\n", micros);
+    }
+    free(path);
+}
+
+void profilerConstructor(Profiler* profiler, char const* program) {
+    memset(profiler, 0, sizeof(Profiler));
+    profiler -> program = program;
+}
+
+void freeProfiler(Profiler* profiler) {
+    free(profiler -> lineStarts);
+    free(profiler -> lines);
+    free(profiler -> functions);
+    free(profiler -> nodes);
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Implementation includes
+#include "astc.h"
+
+// The resolver runs once over every parsed statement and decides where each
+// variable lives, so neither engine has to look names up while running:
+//
+//      * every global lives at the interned id of its name in the global array
+//      * every parameter of a function gets a slot in the function's frame
+//      * every other variable a function assigns also gets a frame slot, but
+//        it only exists once it has been assigned. Until then the name refers
+//        to the global of the same name (this is what keeps the "local shadows
+//        global" and "assign to the global if it exists" rules)
+//      * any other name inside a function is a global
+
+typedef struct Resolver {
+    // one more than the largest interned id seen, so the global array can be sized
+    uint64_t numGlobals;
+
+    // interned id -> frame slot + 1 for the function being resolved (0 for globals)
+    uint32_t* localSlots;
+    uint64_t localCapacity;
+    // the interned id in every slot of the function being resolved, to clear localSlots afterwards
+    uint64_t* frameSymbols;
+    uint64_t frameCapacity;
+    uint64_t numParams;
+    uint64_t numLocals;
+} Resolver;
+
+// makes sure the global array will have room for the given interned id
+void noteSymbol(Resolver* resolver, uint64_t symbol) {
+    if (symbol >= resolver -> numGlobals) {
+        resolver -> numGlobals = symbol + 1;
+    }
+}
+
+// the frame slot + 1 of a name in the function being resolved, or 0 if it is not one of its variables
+uint32_t localSlotOf(Resolver* resolver, uint64_t symbol) {
+    return (symbol < resolver -> localCapacity) ? resolver -> localSlots[symbol] : 0;
+}
+
+// gives the name the next slot of the function's frame
+void addLocal(Resolver* resolver, uint64_t symbol) {
+    if (symbol >= resolver -> localCapacity) {
+        uint64_t capacity = (resolver -> localCapacity == 0) ? 64 : resolver -> localCapacity;
+        while (capacity <= symbol) {
+            capacity *= 2;
+        }
+        resolver -> localSlots = (uint32_t*) (realloc(resolver -> localSlots, sizeof(uint32_t) * capacity));
+        for (uint64_t i = resolver -> localCapacity; i < capacity; i++) {
+            resolver -> localSlots[i] = 0;
+        }
+        resolver -> localCapacity = capacity;
+    }
+    if (resolver -> numLocals == resolver -> frameCapacity) {
+        resolver -> frameCapacity = (resolver -> frameCapacity == 0) ? 16 : resolver -> frameCapacity * 2;
+        resolver -> frameSymbols = (uint64_t*) (realloc(resolver -> frameSymbols, sizeof(uint64_t) * resolver -> frameCapacity));
+    }
+    resolver -> frameSymbols[resolver -> numLocals] = symbol;
+    resolver -> localSlots[symbol] = ++(resolver -> numLocals);
+}
+
+// fills in where the variable with the given name lives
+void resolveName(Resolver* resolver, uint64_t symbol, uint8_t* scope, uint32_t* slot) {
+    noteSymbol(resolver, symbol);
+    uint32_t local = localSlotOf(resolver, symbol);
+    if (local == 0) {
+        *scope = SCOPE_GLOBAL;
+        return;
+    }
+    *slot = local - 1;
+    // parameters always exist, so they never need the global
+    *scope = (*slot < resolver -> numParams) ? SCOPE_PARAMETER : SCOPE_LOCAL;
+}
+
+void resolveExpression(Resolver* resolver, Expression* expression) {
+    if (expression == NULL) {
+        return;
+    }
+    if (expression -> kind == EXPRESSION_VARIABLE) {
+        resolveName(resolver, expression -> symbol, &(expression -> scope), &(expression -> slot));
+    }
+    if (expression -> kind == EXPRESSION_CALL) {
+        noteSymbol(resolver, expression -> symbol);
+    }
+    resolveExpression(resolver, expression -> left);
+    resolveExpression(resolver, expression -> right);
+    for (uint64_t i = 0; i < expression -> numArguments; i++) {
+        resolveExpression(resolver, expression -> arguments[i]);
+    }
+}
+
+void resolveStatement(Resolver* resolver, Statement* statement);
+
+void resolveBlock(Resolver* resolver, Block* block) {
+    for (uint64_t i = 0; i < block -> length; i++) {
+        resolveStatement(resolver, block -> statements[i]);
+    }
+}
+
+// gives a slot to every variable a function body assigns (those are its locals)
+void collectLocals(Resolver* resolver, Block* block) {
+    for (uint64_t i = 0; i < block -> length; i++) {
+        Statement* s = block -> statements[i];
+        if (s -> kind == STATEMENT_ASSIGN && localSlotOf(resolver, s -> symbol) == 0) {
+            addLocal(resolver, s -> symbol);
+        }
+        collectLocals(resolver, &(s -> body));
+        collectLocals(resolver, &(s -> elseBody));
+    }
+}
+
+void resolveFunction(Resolver* resolver, Function* function) {
+    noteSymbol(resolver, function -> symbol);
+
+    // parameters come first, in the order the caller passes its arguments
+    resolver -> numLocals = 0;
+    // (a repeated parameter name refers to the last parameter of that name)
+    for (uint64_t i = 0; i < function -> numParams; i++) {
+        addLocal(resolver, function -> parameters[i]);
+    }
+    resolver -> numParams = resolver -> numLocals;
+    collectLocals(resolver, &(function -> body));
+
+    resolveBlock(resolver, &(function -> body));
+    function -> frameSize = resolver -> numLocals;
+
+    for (uint64_t i = 0; i < resolver -> numLocals; i++) {
+        resolver -> localSlots[resolver -> frameSymbols[i]] = 0;
+    }
+    resolver -> numLocals = 0;
+    resolver -> numParams = 0;
+}
+
+void resolveStatement(Resolver* resolver, Statement* statement) {
+    if (statement -> kind == STATEMENT_ASSIGN) {
+        resolveName(resolver, statement -> symbol, &(statement -> scope), &(statement -> slot));
+    }
+    if (statement -> kind == STATEMENT_FUN) {
+        // the body is resolved once it has been parsed, on the first call
+        noteSymbol(resolver, statement -> function -> symbol);
+    }
+    if (statement -> kind == STATEMENT_RETURN && statement -> expression -> kind == EXPRESSION_CALL) {
+        // nothing is left to do in the caller once the call returns
+        statement -> expression -> position = CALL_TAIL;
+    }
+    resolveExpression(resolver, statement -> expression);
+    resolveBlock(resolver, &(statement -> body));
+    resolveBlock(resolver, &(statement -> elseBody));
+}
+
+void resolverConstructor(Resolver* resolver) {
+    resolver -> numGlobals = 0;
+    resolver -> localSlots = NULL;
+    resolver -> localCapacity = 0;
+    resolver -> frameSymbols = NULL;
+    resolver -> frameCapacity = 0;
+    resolver -> numParams = 0;
+    resolver -> numLocals = 0;
+}
+
+void freeResolver(Resolver* resolver) {
+    free(resolver -> localSlots);
+    free(resolver -> frameSymbols);
+}
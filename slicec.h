@@ -11,6 +11,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "statsc.h"
+
 // A slice represents an immutable substring.
 // Assumptions:
 //      * the underlying string outlives the slice
@@ -99,6 +101,7 @@ void printSlice(Slice const slice) {
 
 // find the hash of the string contained within the slice key
 uint64_t hashSlice(Slice const key) {
+    STAT_ADD(hashes, 1);
     uint64_t out = 5381;
     for (size_t i = 0; i < key.len; i++) {
         char const c = key.start[i];
@@ -0,0 +1,85 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Counts of the interpreter's own work (--stats): statements executed,
+// expression nodes evaluated, calls, the deepest call, and what the hash maps
+// did. Unlike times, the counts are the same on every run of a program, so
+// they can be compared between builds exactly.
+//
+// The counters only exist when the interpreter is built with -DFUN_STATS
+// (make build/main-stats). Otherwise STAT_ADD and STAT_MAX expand to nothing,
+// and the normal build does no extra work at all.
+//
+// The maps and slices count without an interpreter at hand, so the counters
+// are one per thread rather than one per interpreter.
+
+#ifdef FUN_STATS
+
+typedef struct Stats {
+    uint64_t statements;                // statements executed by the tree walker
+    uint64_t expressions;               // expression nodes evaluated by the tree walker
+    uint64_t calls;                     // function calls, tail calls included
+    uint64_t maxDepth;                  // the most calls active at once
+    uint64_t hashes;                    // hashSlice calls
+    uint64_t mapProbes;                 // map slots looked at while finding a key
+    uint64_t mapExpands;                // maps that grew and moved their entries
+    uint64_t mapAllocs;                 // blocks the maps took from their arena
+    uint64_t mapFrees;                  // blocks the maps gave back
+    uint64_t arenaChunks;               // chunks the arenas got from malloc
+} Stats;
+
+__thread Stats stats;
+
+#define STATS_ENABLED true
+#define STAT_ADD(field, n) (stats.field += (n))
+#define STAT_MAX(field, n) ((stats.field < (n)) ? (void) (stats.field = (n)) : (void) 0)
+
+// (name, field) for every counter, in the order they are reported
+#define STATS_FIELDS(X)                     \
+    X("statements", statements)             \
+    X("expressions", expressions)           \
+    X("calls", calls)                       \
+    X("max_depth", maxDepth)                \
+    X("hashes", hashes)                     \
+    X("map_probes", mapProbes)              \
+    X("map_expands", mapExpands)            \
+    X("map_allocs", mapAllocs)              \
+    X("map_frees", mapFrees)                \
+    X("arena_chunks", arenaChunks)
+
+// one "name count" line per counter
+void statsReport(FILE* out) {
+#define STATS_LINE(name, field) fprintf(out, "%-16s %14lu\n", name, (unsigned long) stats.field);
+    STATS_FIELDS(STATS_LINE)
+#undef STATS_LINE
+}
+
+// the same counts as one JSON object
+void statsWriteJson(FILE* out) {
+    char const* separator = "{";
+#define STATS_MEMBER(name, field) fprintf(out, "%s\n  \"%s\": %lu", separator, name, (unsigned long) stats.field); separator = ",";
+    STATS_FIELDS(STATS_MEMBER)
+#undef STATS_MEMBER
+    fprintf(out, "\n}\n");
+}
+
+#else
+
+#define STATS_ENABLED false
+#define STAT_ADD(field, n) ((void) 0)
+#define STAT_MAX(field, n) ((void) 0)
+
+// (main refuses --stats in this build, so these are never called)
+void statsReport(FILE* out) {
+    (void) out;
+}
+
+void statsWriteJson(FILE* out) {
+    (void) out;
+}
+
+#endif
@@ -0,0 +1,8 @@
+# runs the programs in batch/ (and one that does not exist) on four threads, named on the command line
+# and then listed on stdin. The slow one comes first, so the others finish before it. Every program
+# gets its own globals and functions, and one failing does not stop the others
+dir=$(dirname "$2")/batch
+"$1" --batch --jobs 4 --no-jit "$dir/slow.fun" "$dir/fails.fun" "$dir/missing.fun" "$dir/globals.fun" "$dir/deep.fun" "$dir/slow.fun"
+echo "exit $?"
+printf '%s\n' "$dir/globals.fun" "$dir/slow.fun" | "$1" --batch --jobs 4
+echo "exit $?"
@@ -0,0 +1,30 @@
+# runs the program with --cache: writing the cache and using it, then after each change that must make the
+# cached tokens unusable, which must lex the source again and print what the source says:
+# an edit that keeps the size and the modification time, a damaged literal and a damaged first token in the
+# cache file, and an edit that changes the size
+dir=$(mktemp -d)
+cp "$2" "$dir/program.fun"
+touch "$dir/stamp"
+touch -r "$dir/program.fun" "$dir/stamp"
+"$1" --cache "$dir" "$dir/program.fun"
+"$1" --cache "$dir" "$dir/program.fun"
+
+# 21 becomes 35 in place (same file, same size), and the modification time is put back
+printf '35' | dd of="$dir/program.fun" bs=1 seek=38 conv=notrunc 2> /dev/null
+touch -r "$dir/stamp" "$dir/program.fun"
+"$1" --cache "$dir" "$dir/program.fun"
+
+# (the header is 96 bytes, each token 16: its kind, its offset and then its value. Token 13 is the 35)
+for file in "$dir"/*.tokens; do
+    printf '\003' | dd of="$file" bs=1 seek=312 conv=notrunc 2> /dev/null
+done
+"$1" --cache "$dir" "$dir/program.fun"
+for file in "$dir"/*.tokens; do
+    head -c 16 /dev/zero | tr '\0' '\377' | dd of="$file" bs=1 seek=96 conv=notrunc 2> /dev/null
+done
+"$1" --cache "$dir" "$dir/program.fun"
+
+echo "print(99)" >> "$dir/program.fun"
+"$1" --cache "$dir" "$dir/program.fun"
+echo "exit $?"
+rm -rf "$dir"
@@ -0,0 +1,5 @@
+# compiles the program with -S, links it and runs it, then prints its exit status
+dir=$(mktemp -d)
+"$1" -S "$2" > "$dir/test.s" && gcc -o "$dir/test.run" -static "$dir/test.s" && "$dir/test.run"
+echo "exit $?"
+rm -rf "$dir"
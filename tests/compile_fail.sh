@@ -0,0 +1,2 @@
+# the same as compile.sh
+. "$(dirname "$0")/compile.sh"
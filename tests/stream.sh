@@ -0,0 +1,28 @@
+# pipes the program in a line at a time and, after a line starting with print, waits for its output
+# before sending the next one, like a generator that reacts to what the program prints. If the
+# output only came at the end of the input, this would wait forever, so it gives up after 5 seconds
+dir=$(mktemp -d)
+mkfifo "$dir/in"
+"$1" < "$dir/in" > "$dir/out" &
+exec 3> "$dir/in"
+while IFS= read -r line; do
+    before=$(wc -l < "$dir/out")
+    printf '%s\n' "$line" >&3
+    case "$line" in
+        print*)
+            tries=0
+            while [ "$(wc -l < "$dir/out")" -le "$before" ]; do
+                tries=$((tries + 1))
+                if [ $tries -gt 500 ]; then
+                    echo "no output for: $line"
+                    break
+                fi
+                sleep 0.01
+            done
+            ;;
+    esac
+done < "$2"
+exec 3>&-
+wait
+cat "$dir/out"
+rm -rf "$dir"
@@ -0,0 +1,3 @@
+# pipes the whole program in at once
+cat "$2" | "$1"
+echo "exit $?"
@@ -0,0 +1,586 @@
+#pragma once
+
+// libc includes (available in both C and C++)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Implementation includes
+#include "interpreterc.h"
+
+// A second execution engine: each top-level statement is compiled to bytecode
+// and run on a stack machine. Variables use the slots the resolver gave them:
+// locals live in the running function's frame, globals in the interpreter's
+// global array. Frames and operands share the interpreter's frame stack.
+//
+//      stack:  ... | caller frame | params | locals | operands ...
+//                                 ^ base                        ^ sp
+
+typedef enum Opcode {
+    OP_PUSH,                // push b
+    OP_LOAD_GLOBAL,         // push global a (globals are numbered by the interned ids of their names)
+    OP_LOAD_LOCAL,          // push local a
+    OP_LOAD_NAME,           // push local a if it was assigned, otherwise global b
+    OP_STORE_GLOBAL,        // pop into global a
+    OP_STORE_LOCAL,         // pop into local a
+    OP_STORE_NAME,          // pop into local a if it was assigned, else global b if it was assigned, else local a
+    OP_SHARE,               // copy the top value into local a, leaving it on the stack
+
+    OP_NOT,
+    OP_TRUTH,
+    OP_MULTIPLY,
+    OP_DIVIDE,
+    OP_MODULO,
+    OP_ADD,
+    OP_SUBTRACT,
+    OP_LESS,
+    OP_LESS_EQUAL,
+    OP_GREATER,
+    OP_GREATER_EQUAL,
+    OP_EQUAL,
+    OP_NOT_EQUAL,
+    OP_AND,
+    OP_OR,
+
+    OP_JUMP,                // continue at instruction a
+    OP_JUMP_IF_ZERO,        // pop, continue at instruction a if it was 0
+    OP_CHECK_FUNCTION,      // fail unless the function whose name has interned id a is declared (before its arguments)
+    OP_CALL,                // call the function whose name has interned id a, with the top b values as arguments
+    OP_TAIL_CALL,           // same as OP_CALL, but the callee takes over the running frame (return f(...))
+    OP_RETURN,              // pop the return value, drop the frame and push the return value for the caller
+    OP_POP,
+    OP_DEFINE,              // declare functions[a]
+    OP_HALT                 // end of a top-level statement
+} Opcode;
+
+typedef struct Instruction {
+    uint32_t opcode;
+    uint32_t a;
+    uint64_t b;
+} Instruction;
+
+typedef struct CallFrame {
+    uint64_t returnAddress;         // index of the instruction to continue at (code can move while calling)
+    uint64_t base;                  // first stack slot of the caller's frame
+} CallFrame;
+
+typedef struct Vm {
+    Interpreter* interpreter;
+
+    Instruction* code;
+    uint32_t* offsets;              // program offset of every instruction, for error messages
+    uint64_t codeLength;
+    uint64_t codeCapacity;
+
+    // declarations referenced by instructions
+    Function** functions;
+    uint64_t numFunctions;
+    uint64_t functionCapacity;
+
+    // operand stack depth while compiling
+    uint64_t depth;                 // operand stack depth at the current instruction
+    uint64_t maxDepth;
+
+    // return information for every active call
+    CallFrame* frames;
+    uint64_t frameCapacity;
+} Vm;
+
+uint64_t emit(Vm* vm, uint32_t opcode, uint32_t a, uint64_t b, uint32_t offset) {
+    if (vm -> codeLength == vm -> codeCapacity) {
+        vm -> codeCapacity *= 2;
+        vm -> code = (Instruction*) (realloc(vm -> code, sizeof(Instruction) * vm -> codeCapacity));
+        vm -> offsets = (uint32_t*) (realloc(vm -> offsets, sizeof(uint32_t) * vm -> codeCapacity));
+    }
+    Instruction* instruction = &(vm -> code[vm -> codeLength]);
+    instruction -> opcode = opcode;
+    instruction -> a = a;
+    instruction -> b = b;
+    vm -> offsets[vm -> codeLength] = offset;
+    return vm -> codeLength++;
+}
+
+// keeps track of how deep the operand stack gets, so a call can make room for its whole frame up front
+void adjustDepth(Vm* vm, int64_t change) {
+    vm -> depth += change;
+    if (vm -> depth > vm -> maxDepth) {
+        vm -> maxDepth = vm -> depth;
+    }
+}
+
+void compileExpression(Vm* vm, Expression* expression) {
+    switch (expression -> kind) {
+        case EXPRESSION_LITERAL:
+            emit(vm, OP_PUSH, 0, expression -> value, expression -> offset);
+            adjustDepth(vm, 1);
+            return;
+
+        case EXPRESSION_VARIABLE:
+            if (expression -> scope == SCOPE_PARAMETER) {
+                emit(vm, OP_LOAD_LOCAL, expression -> slot, 0, expression -> offset);
+            }
+            else if (expression -> scope == SCOPE_LOCAL) {
+                emit(vm, OP_LOAD_NAME, expression -> slot, expression -> symbol, expression -> offset);
+            }
+            else {
+                emit(vm, OP_LOAD_GLOBAL, expression -> symbol, 0, expression -> offset);
+            }
+            adjustDepth(vm, 1);
+            return;
+
+        case EXPRESSION_CALL: {
+            // a function that is declared now stays declared, so only a call that may reach none checks first
+            if (vm -> interpreter -> functions[expression -> symbol] == NULL) {
+                emit(vm, OP_CHECK_FUNCTION, expression -> symbol, 0,
+                    missingFunctionOffset(&(vm -> interpreter -> parser), expression));
+            }
+            for (uint64_t i = 0; i < expression -> numArguments; i++) {
+                compileExpression(vm, expression -> arguments[i]);
+            }
+            emit(vm, (expression -> position == CALL_TAIL) ? OP_TAIL_CALL : OP_CALL, expression -> symbol, expression -> numArguments,
+                expression -> end);
+            adjustDepth(vm, 1 - (int64_t) expression -> numArguments);
+            return;
+        }
+
+        case EXPRESSION_SHARE:
+            compileExpression(vm, expression -> left);
+            emit(vm, OP_SHARE, expression -> slot, 0, expression -> offset);
+            return;
+
+        case EXPRESSION_NOT:
+            compileExpression(vm, expression -> left);
+            emit(vm, OP_NOT, 0, 0, expression -> offset);
+            return;
+
+        case EXPRESSION_TRUTH:
+            compileExpression(vm, expression -> left);
+            emit(vm, OP_TRUTH, 0, 0, expression -> offset);
+            return;
+    }
+
+    // binary operators map onto opcodes in the same order as the expression kinds
+    compileExpression(vm, expression -> left);
+    compileExpression(vm, expression -> right);
+    emit(vm, OP_MULTIPLY + (expression -> kind - EXPRESSION_MULTIPLY), 0, 0, expression -> offset);
+    adjustDepth(vm, -1);
+}
+
+void compileStatement(Vm* vm, Statement* statement);
+
+void compileBlock(Vm* vm, Block* block) {
+    for (uint64_t i = 0; i < block -> length; i++) {
+        compileStatement(vm, block -> statements[i]);
+    }
+}
+
+// compiles a function the first time it is called, after the code compiled so far
+void compileFunction(Vm* vm, Function* function) {
+    uint32_t offset = function -> offset;
+    uint64_t outerDepth = vm -> depth;
+    uint64_t outerMaxDepth = vm -> maxDepth;
+    vm -> depth = 0;
+    vm -> maxDepth = 0;
+
+    function -> entry = vm -> codeLength;
+    compileBlock(vm, &(function -> body));
+
+    // if a return statement is never hit, the function returns 0
+    emit(vm, OP_PUSH, 0, 0, offset);
+    adjustDepth(vm, 1);
+    emit(vm, OP_RETURN, 0, 0, offset);
+
+    function -> maxStack = vm -> maxDepth;
+
+    vm -> depth = outerDepth;
+    vm -> maxDepth = outerMaxDepth;
+    function -> compiled = true;
+}
+
+void compileStatement(Vm* vm, Statement* statement) {
+    switch (statement -> kind) {
+        case STATEMENT_ASSIGN:
+            compileExpression(vm, statement -> expression);
+            if (statement -> scope == SCOPE_PARAMETER) {
+                emit(vm, OP_STORE_LOCAL, statement -> slot, 0, statement -> offset);
+            }
+            else if (statement -> scope == SCOPE_LOCAL) {
+                emit(vm, OP_STORE_NAME, statement -> slot, statement -> symbol, statement -> offset);
+            }
+            else {
+                emit(vm, OP_STORE_GLOBAL, statement -> symbol, 0, statement -> offset);
+            }
+            adjustDepth(vm, -1);
+            return;
+
+        case STATEMENT_CALL:
+            compileExpression(vm, statement -> expression);
+            emit(vm, OP_POP, 0, 0, statement -> offset);
+            adjustDepth(vm, -1);
+            return;
+
+        case STATEMENT_IF: {
+            compileExpression(vm, statement -> expression);
+            uint64_t toElse = emit(vm, OP_JUMP_IF_ZERO, 0, 0, statement -> offset);
+            adjustDepth(vm, -1);
+            compileBlock(vm, &(statement -> body));
+            if (statement -> elseBody.length == 0) {
+                vm -> code[toElse].a = vm -> codeLength;
+                return;
+            }
+            uint64_t toEnd = emit(vm, OP_JUMP, 0, 0, statement -> offset);
+            vm -> code[toElse].a = vm -> codeLength;
+            compileBlock(vm, &(statement -> elseBody));
+            vm -> code[toEnd].a = vm -> codeLength;
+            return;
+        }
+
+        case STATEMENT_WHILE: {
+            uint64_t top = vm -> codeLength;
+            compileExpression(vm, statement -> expression);
+            uint64_t toEnd = emit(vm, OP_JUMP_IF_ZERO, 0, 0, statement -> offset);
+            adjustDepth(vm, -1);
+            compileBlock(vm, &(statement -> body));
+            emit(vm, OP_JUMP, top, 0, statement -> offset);
+            vm -> code[toEnd].a = vm -> codeLength;
+            return;
+        }
+
+        case STATEMENT_RETURN:
+            compileExpression(vm, statement -> expression);
+            emit(vm, OP_RETURN, 0, 0, statement -> offset);
+            adjustDepth(vm, -1);
+            return;
+
+        case STATEMENT_FUN:
+            if (vm -> numFunctions == vm -> functionCapacity) {
+                vm -> functionCapacity *= 2;
+                vm -> functions = (Function**) (realloc(vm -> functions, sizeof(Function*) * vm -> functionCapacity));
+            }
+            vm -> functions[vm -> numFunctions] = statement -> function;
+            emit(vm, OP_DEFINE, vm -> numFunctions++, 0, statement -> offset);
+            return;
+    }
+}
+
+void vmFail(Vm* vm, Instruction* ip) {
+    failAt(&(vm -> interpreter -> parser), vm -> offsets[ip - vm -> code]);
+}
+
+// runs the code starting at the given instruction until it halts
+void executeCode(Vm* vm, uint64_t start) {
+    // compiling a function on its first call can move the code and the globals
+    Instruction* code = vm -> code;
+    uint64_t* globals = vm -> interpreter -> globals;
+    bool* globalDefined = vm -> interpreter -> globalDefined;
+    Interpreter* const interpreter = vm -> interpreter;
+
+    // base and defined point at the running frame's slots and their defined flags
+    Instruction* ip = code + start;
+    uint64_t* base = interpreter -> stack;
+    bool* defined = interpreter -> stackDefined;
+    uint64_t* sp = interpreter -> stack;
+    uint64_t depth = 0;
+
+// GCC and clang can jump straight to the next handler; other compilers go through a switch
+#ifdef __GNUC__
+    static void* const dispatch[] = {
+        &&OP_PUSH_label, &&OP_LOAD_GLOBAL_label, &&OP_LOAD_LOCAL_label, &&OP_LOAD_NAME_label,
+        &&OP_STORE_GLOBAL_label, &&OP_STORE_LOCAL_label, &&OP_STORE_NAME_label, &&OP_SHARE_label,
+        &&OP_NOT_label, &&OP_TRUTH_label, &&OP_MULTIPLY_label, &&OP_DIVIDE_label, &&OP_MODULO_label,
+        &&OP_ADD_label, &&OP_SUBTRACT_label, &&OP_LESS_label, &&OP_LESS_EQUAL_label,
+        &&OP_GREATER_label, &&OP_GREATER_EQUAL_label, &&OP_EQUAL_label, &&OP_NOT_EQUAL_label,
+        &&OP_AND_label, &&OP_OR_label,
+        &&OP_JUMP_label, &&OP_JUMP_IF_ZERO_label, &&OP_CHECK_FUNCTION_label, &&OP_CALL_label, &&OP_TAIL_CALL_label,
+        &&OP_RETURN_label, &&OP_POP_label, &&OP_DEFINE_label, &&OP_HALT_label
+    };
+    #define CASE(op) op##_label: case op
+    #define DISPATCH() goto *dispatch[ip -> opcode]
+    DISPATCH();
+#else
+    #define CASE(op) case op
+    #define DISPATCH() continue
+#endif
+
+    #define BINARY(expression) { uint64_t u = *(--sp); uint64_t v = sp[-1]; sp[-1] = (expression); ip++; DISPATCH(); }
+
+    while (true) {
+        switch (ip -> opcode) {
+            CASE(OP_PUSH):
+                *(sp++) = ip -> b;
+                ip++;
+                DISPATCH();
+
+            CASE(OP_LOAD_GLOBAL):
+                *(sp++) = globals[ip -> a];
+                ip++;
+                DISPATCH();
+
+            CASE(OP_LOAD_LOCAL):
+                *(sp++) = base[ip -> a];
+                ip++;
+                DISPATCH();
+
+            CASE(OP_LOAD_NAME):
+                // utilize the local variable first, if no local variable, use global variable
+                *(sp++) = defined[ip -> a] ? base[ip -> a] : globals[ip -> b];
+                ip++;
+                DISPATCH();
+
+            CASE(OP_STORE_GLOBAL):
+                globals[ip -> a] = *(--sp);
+                globalDefined[ip -> a] = true;
+                ip++;
+                DISPATCH();
+
+            CASE(OP_STORE_LOCAL):
+                base[ip -> a] = *(--sp);
+                ip++;
+                DISPATCH();
+
+            CASE(OP_STORE_NAME): {
+                uint64_t v = *(--sp);
+                if (!defined[ip -> a] && globalDefined[ip -> b]) {
+                    // update the global variable
+                    globals[ip -> b] = v;
+                }
+                else {
+                    // update the local variable, or create a new local variable
+                    base[ip -> a] = v;
+                    defined[ip -> a] = true;
+                }
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(OP_SHARE):
+                base[ip -> a] = sp[-1];
+                ip++;
+                DISPATCH();
+
+            CASE(OP_NOT):
+                sp[-1] = (sp[-1] == 0) ? 1 : 0;
+                ip++;
+                DISPATCH();
+
+            CASE(OP_TRUTH):
+                sp[-1] = (sp[-1] != 0) ? 1 : 0;
+                ip++;
+                DISPATCH();
+
+            CASE(OP_MULTIPLY): BINARY(v * u)
+            CASE(OP_DIVIDE): BINARY((u == 0) ? 0 : v / u)
+            CASE(OP_MODULO): BINARY((u == 0) ? 0 : v % u)
+            CASE(OP_ADD): BINARY(v + u)
+            CASE(OP_SUBTRACT): BINARY(v - u)
+            CASE(OP_LESS): BINARY((v < u) ? 1 : 0)
+            CASE(OP_LESS_EQUAL): BINARY((v <= u) ? 1 : 0)
+            CASE(OP_GREATER): BINARY((v > u) ? 1 : 0)
+            CASE(OP_GREATER_EQUAL): BINARY((v >= u) ? 1 : 0)
+            CASE(OP_EQUAL): BINARY((v == u) ? 1 : 0)
+            CASE(OP_NOT_EQUAL): BINARY((v != u) ? 1 : 0)
+            CASE(OP_AND): BINARY((v && u) ? 1 : 0)
+            CASE(OP_OR): BINARY((v || u) ? 1 : 0)
+
+            CASE(OP_JUMP):
+                ip = code + ip -> a;
+                DISPATCH();
+
+            CASE(OP_JUMP_IF_ZERO):
+                ip = (*(--sp) == 0) ? code + ip -> a : ip + 1;
+                DISPATCH();
+
+            CASE(OP_CHECK_FUNCTION):
+                if (interpreter -> functions[ip -> a] == NULL) {
+                    vmFail(vm, ip);
+                }
+                ip++;
+                DISPATCH();
+
+            CASE(OP_TAIL_CALL): {
+                Function* function = interpreter -> functions[ip -> a];
+                if (function == NULL || ip -> b != function -> numParams) {
+                    vmFail(vm, ip);
+                }
+                // builtins and machine code get an ordinary call, the OP_RETURN after this one returns their value
+                if (function -> native != NULL || function -> jitEntry != NULL) {
+                    goto OP_CALL_body;
+                }
+
+                if (!function -> compiled) {
+                    uint64_t at = ip - code;
+                    prepareFunction(interpreter, function);
+                    compileFunction(vm, function);
+                    code = vm -> code;
+                    ip = code + at;
+                    globals = interpreter -> globals;
+                    globalDefined = interpreter -> globalDefined;
+                }
+                jitCount(&(interpreter -> jit), function);
+                if (function -> jitEntry != NULL) {
+                    goto OP_CALL_body;
+                }
+
+                // move the arguments down to where the running frame starts, and run the callee in it
+                uint64_t baseIndex = base - interpreter -> stack;
+                memmove(base, sp - function -> numParams, sizeof(uint64_t) * function -> numParams);
+                uint64_t needed = baseIndex + function -> frameSize + function -> maxStack;
+                if (needed > interpreter -> stackCapacity) {
+                    reserveStack(interpreter, needed);
+                    base = interpreter -> stack + baseIndex;
+                    defined = interpreter -> stackDefined + baseIndex;
+                }
+                memset(defined + function -> numParams, 0, function -> frameSize - function -> numParams);
+                sp = base + function -> frameSize;
+                ip = code + function -> entry;
+                DISPATCH();
+            }
+
+            CASE(OP_CALL): {
+            OP_CALL_body:;
+                Function* function = interpreter -> functions[ip -> a];
+                if (function == NULL || ip -> b != function -> numParams) {
+                    vmFail(vm, ip);
+                }
+                if (function -> native != NULL) {
+                    sp -= function -> numParams;
+                    *sp = function -> native(interpreter, sp);
+                    sp++;
+                    ip++;
+                    DISPATCH();
+                }
+
+                // fail cleanly on runaway recursion
+                if (depth == interpreter -> maxDepth) {
+                    vmFail(vm, ip);
+                }
+
+                if (!function -> compiled) {
+                    uint64_t at = ip - code;
+                    prepareFunction(interpreter, function);
+                    compileFunction(vm, function);
+                    code = vm -> code;
+                    ip = code + at;
+                    globals = interpreter -> globals;
+                    globalDefined = interpreter -> globalDefined;
+                }
+
+                if (function -> jitEntry == NULL) {
+                    jitCount(&(interpreter -> jit), function);
+                }
+                if (function -> jitEntry != NULL) {
+                    // the machine code takes the arguments where they are, and counts as one more frame
+                    sp -= function -> numParams;
+                    *sp = ((JitEntry) function -> jitEntry)(sp, globals, globalDefined, interpreter -> maxDepth - depth - 1);
+                    sp++;
+                    ip++;
+                    DISPATCH();
+                }
+
+                // the arguments already on the stack become the first slots of the new frame
+                uint64_t baseIndex = base - interpreter -> stack;
+                uint64_t newBaseIndex = (sp - interpreter -> stack) - function -> numParams;
+                uint64_t needed = newBaseIndex + function -> frameSize + function -> maxStack;
+                if (needed > interpreter -> stackCapacity) {
+                    reserveStack(interpreter, needed);
+                }
+                if (depth == vm -> frameCapacity) {
+                    vm -> frameCapacity *= 2;
+                    vm -> frames = (CallFrame*) (realloc(vm -> frames, sizeof(CallFrame) * vm -> frameCapacity));
+                }
+                vm -> frames[depth].returnAddress = (ip + 1) - code;
+                vm -> frames[depth].base = baseIndex;
+                depth++;
+
+                // none of the new frame's locals exist yet
+                base = interpreter -> stack + newBaseIndex;
+                defined = interpreter -> stackDefined + newBaseIndex;
+                memset(defined + function -> numParams, 0, function -> frameSize - function -> numParams);
+                sp = base + function -> frameSize;
+                ip = code + function -> entry;
+                DISPATCH();
+            }
+
+            CASE(OP_RETURN): {
+                uint64_t v = *(--sp);
+                sp = base;
+                depth--;
+                base = interpreter -> stack + vm -> frames[depth].base;
+                defined = interpreter -> stackDefined + vm -> frames[depth].base;
+                ip = code + vm -> frames[depth].returnAddress;
+                *(sp++) = v;
+                DISPATCH();
+            }
+
+            CASE(OP_POP):
+                sp--;
+                ip++;
+                DISPATCH();
+
+            CASE(OP_DEFINE): {
+                Function* function = vm -> functions[ip -> a];
+                interpreter -> functions[function -> symbol] = function;
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(OP_HALT):
+                return;
+        }
+    }
+
+    #undef BINARY
+    #undef CASE
+    #undef DISPATCH
+}
+
+// parses, compiles and runs one top-level statement at a time, like run() does for the tree walker
+void runVm(Vm* vm) {
+    // the vm keeps its frames off the C stack, but machine code for hot functions does not
+    limitCStack(vm -> interpreter);
+    Statement* s;
+    while ((s = nextStatement(vm -> interpreter)) != NULL) {
+        vm -> depth = 0;
+        vm -> maxDepth = 0;
+        uint64_t start = vm -> codeLength;
+        compileStatement(vm, s);
+        uint64_t end = emit(vm, OP_HALT, 0, 0, s -> offset) + 1;
+        reserveStack(vm -> interpreter, vm -> maxDepth);
+
+        executeCode(vm, start);
+        // the statement's code is not needed anymore, unless a function was compiled after it
+        if (vm -> codeLength == end) {
+            vm -> codeLength = start;
+        }
+    }
+}
+
+Vm* vmConstructor(Interpreter* interpreter) {
+    Vm* vm = (Vm*) (calloc(1, sizeof(Vm)));
+    vm -> interpreter = interpreter;
+
+    vm -> codeCapacity = 256;
+    vm -> code = (Instruction*) (malloc(sizeof(Instruction) * vm -> codeCapacity));
+    vm -> offsets = (uint32_t*) (malloc(sizeof(uint32_t) * vm -> codeCapacity));
+
+    vm -> functionCapacity = 16;
+    vm -> functions = (Function**) (malloc(sizeof(Function*) * vm -> functionCapacity));
+
+    vm -> frameCapacity = 64;
+    vm -> frames = (CallFrame*) (malloc(sizeof(CallFrame) * vm -> frameCapacity));
+    return vm;
+}
+
+void freeVm(Vm* vm) {
+    free(vm -> code);
+    free(vm -> offsets);
+    free(vm -> functions);
+    free(vm -> frames);
+    free(vm);
+}